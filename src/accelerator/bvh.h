@@ -1,10 +1,22 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <utility>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <ostream>
+#include <omp.h>
 #include "core/aabb.h"
+#include "core/ray_packet.h"
 #include "core/ray.h"
+#include "core/stats.h"
 #include "hittable.h"
+#include "packet_bvh.h"
+#include "wide_bvh.h"
 
 namespace hasmet {
 
@@ -20,6 +32,50 @@ struct LinearBvhNode {
   uint8_t pad;
 };
 
+enum class BvhSplitMethod { Median, SAH, SBVH };
+
+// Median splits every node at the centroid median of its longest axis and
+// only stops at single primitives. SAH bins centroids along all three axes
+// and picks the cheapest plane under the cost model below. SBVH additionally
+// considers spatial splits that clip straddling primitives into both
+// children, adding at most spatial_split_budget * N references; primitive
+// types that cannot be clipped fall back to SAH. The binary tree is always
+// built; Wide4 additionally collapses it into 4-wide nodes that are used for
+// traversal.
+struct BvhBuildConfig {
+  BvhSplitMethod split_method = BvhSplitMethod::SAH;
+  BvhLayout layout = BvhLayout::Wide4;
+  int num_bins = 16;
+  int max_leaf_size = 4;
+  float traversal_cost = 1.0f;
+  float intersection_cost = 1.0f;
+  float spatial_split_budget = 0.3f;
+};
+
+// Spatial splits are only tried where the children of the best object split
+// overlap by more than this fraction of the root area.
+constexpr float kSpatialSplitAlpha = 1e-5f;
+
+constexpr int kMaxBvhBins = 128;
+
+// Leaves are at most kMaxBvhDepth - 1 levels below the root, which bounds
+// the fixed traversal stacks. SAH and spatial splits have no depth bound of
+// their own, so the builders switch to count median splits, which halve a
+// node per level, once a node has only just enough depth left for those.
+constexpr int kMaxBvhDepth = 64;
+
+inline bool bvh_depth_exhausted(int depth, int num_primitives) {
+  int median_levels =
+      std::bit_width(static_cast<unsigned>(std::max(num_primitives, 1) - 1));
+  return depth + median_levels >= kMaxBvhDepth - 1;
+}
+
+struct BvhPrimitiveInfo {
+  AABB bounds;
+  Vec3 centroid;
+  int index = 0;
+};
+
 struct BvhBuildNode {
   AABB bounds;
   BvhBuildNode* left = nullptr;
@@ -44,30 +100,197 @@ struct BvhBuildNode {
   }
 };
 
-template <typename T>
-BvhBuildNode* recursive_build(std::vector<T>& objects,
-                              int start, int end) {
-  BvhBuildNode* node = new BvhBuildNode();
+// Monotonic pool for the build nodes of one BVH::build call. Each OpenMP
+// thread carves nodes out of its own block, so allocation is a pointer bump
+// without locking; everything is released at once when the arena dies.
+class BvhNodeArena {
+ public:
+  static constexpr int kBlockSize = 4096;
+
+  explicit BvhNodeArena(int num_threads) : slots_(num_threads) {}
+
+  BvhBuildNode* alloc() {
+    Slot& slot = slots_[omp_get_thread_num()];
+    if (slot.next == slot.end) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      blocks_.push_back(std::make_unique<BvhBuildNode[]>(kBlockSize));
+      slot.next = blocks_.back().get();
+      slot.end = slot.next + kBlockSize;
+    }
+    return slot.next++;
+  }
+
+  int size() const {
+    size_t unused = 0;
+    for (const Slot& slot : slots_) unused += slot.end - slot.next;
+    return static_cast<int>(blocks_.size() * kBlockSize - unused);
+  }
+
+ private:
+  struct alignas(64) Slot {
+    BvhBuildNode* next = nullptr;
+    BvhBuildNode* end = nullptr;
+  };
+
+  std::vector<Slot> slots_;
+  std::vector<std::unique_ptr<BvhBuildNode[]>> blocks_;
+  std::mutex mutex_;
+};
+
+struct BvhSplit {
+  int axis = -1;
+  int bin = 0;
+  float cost = INFINITY;
+};
+
+struct BvhBin {
   AABB bounds;
+  int count = 0;
+};
+
+using BvhBinSet = std::array<std::array<BvhBin, kMaxBvhBins>, 3>;
+
+// Ranges larger than this are split into subtree tasks.
+constexpr int kParallelBuildThreshold = 4096;
+// Ranges larger than this also reduce bounds and bins with chunked tasks.
+constexpr int kParallelReduceThreshold = 1 << 16;
+constexpr int kReduceChunkSize = 1 << 14;
+
+inline int bvh_bin_index(const AABB& centroid_bounds, int axis, int num_bins,
+                         const Vec3& centroid) {
+  const Interval& extent = centroid_bounds[axis];
+  int b = static_cast<int>(num_bins * (centroid[axis] - extent.min) /
+                           extent.getLength());
+  return std::clamp(b, 0, num_bins - 1);
+}
 
-  if (start < end) bounds = objects[start].get_aabb();
-  for (int i = start + 1; i < end; ++i) {
-    bounds.expand(objects[i].get_aabb());
+inline void compute_bounds(const std::vector<BvhPrimitiveInfo>& infos,
+                           int start, int end, AABB& bounds,
+                           AABB& centroid_bounds) {
+  if (end - start < kParallelReduceThreshold) {
+    for (int i = start; i < end; ++i) {
+      bounds.expand(infos[i].bounds);
+      centroid_bounds.expand(infos[i].centroid);
+    }
+    return;
   }
 
-  int num_primitives = end - start;
-  if (num_primitives == 1) {
-    node->init_leaf(start, num_primitives, bounds);
-    return node;
+  int num_chunks = (end - start + kReduceChunkSize - 1) / kReduceChunkSize;
+  std::vector<AABB> chunk_bounds(num_chunks);
+  std::vector<AABB> chunk_centroids(num_chunks);
+#pragma omp taskloop grainsize(1) shared(infos, chunk_bounds, chunk_centroids)
+  for (int c = 0; c < num_chunks; ++c) {
+    int chunk_end = std::min(end, start + (c + 1) * kReduceChunkSize);
+    for (int i = start + c * kReduceChunkSize; i < chunk_end; ++i) {
+      chunk_bounds[c].expand(infos[i].bounds);
+      chunk_centroids[c].expand(infos[i].centroid);
+    }
   }
 
-  AABB centroid_bounds = AABB();
+  for (int c = 0; c < num_chunks; ++c) {
+    bounds.expand(chunk_bounds[c]);
+    centroid_bounds.expand(chunk_centroids[c]);
+  }
+}
+
+inline void bin_primitives(const std::vector<BvhPrimitiveInfo>& infos,
+                           int start, int end, const AABB& centroid_bounds,
+                           int num_bins, BvhBinSet& bins) {
   for (int i = start; i < end; ++i) {
-    centroid_bounds.expand(objects[i].get_aabb().centroid());
+    for (int axis = 0; axis < 3; ++axis) {
+      if (centroid_bounds[axis].getLength() <= 0.0f) continue;
+      int b = bvh_bin_index(centroid_bounds, axis, num_bins,
+                            infos[i].centroid);
+      bins[axis][b].count++;
+      bins[axis][b].bounds.expand(infos[i].bounds);
+    }
   }
+}
 
-  int dim = centroid_bounds.longest_axis();
-  int mid = (start + end) / 2;
+inline BvhSplit find_sah_split(const std::vector<BvhPrimitiveInfo>& infos,
+                               int start, int end, const AABB& bounds,
+                               const AABB& centroid_bounds,
+                               const BvhBuildConfig& config) {
+  const int num_bins = std::clamp(config.num_bins, 2, kMaxBvhBins);
+  const float inv_area = 1.0f / bounds.surface_area();
+  BvhSplit best;
+
+  BvhBinSet bins;
+  if (end - start < kParallelReduceThreshold) {
+    bin_primitives(infos, start, end, centroid_bounds, num_bins, bins);
+  } else {
+    int num_chunks = (end - start + kReduceChunkSize - 1) / kReduceChunkSize;
+    std::vector<BvhBinSet> chunk_bins(num_chunks);
+#pragma omp taskloop grainsize(1) shared(infos, centroid_bounds, chunk_bins)
+    for (int c = 0; c < num_chunks; ++c) {
+      int chunk_end = std::min(end, start + (c + 1) * kReduceChunkSize);
+      bin_primitives(infos, start + c * kReduceChunkSize, chunk_end,
+                     centroid_bounds, num_bins, chunk_bins[c]);
+    }
+    for (const BvhBinSet& chunk : chunk_bins) {
+      for (int axis = 0; axis < 3; ++axis) {
+        for (int b = 0; b < num_bins; ++b) {
+          bins[axis][b].count += chunk[axis][b].count;
+          bins[axis][b].bounds.expand(chunk[axis][b].bounds);
+        }
+      }
+    }
+  }
+
+  for (int axis = 0; axis < 3; ++axis) {
+    if (centroid_bounds[axis].getLength() <= 0.0f) continue;
+    const std::array<BvhBin, kMaxBvhBins>& axis_bins = bins[axis];
+
+    // Sweep from the right to collect the area/count of every suffix, then
+    // from the left to evaluate each candidate plane.
+    std::array<float, kMaxBvhBins> right_area;
+    std::array<int, kMaxBvhBins> right_count;
+    AABB acc;
+    int count = 0;
+    for (int b = num_bins - 1; b > 0; --b) {
+      acc.expand(axis_bins[b].bounds);
+      count += axis_bins[b].count;
+      right_area[b] = count > 0 ? acc.surface_area() : 0.0f;
+      right_count[b] = count;
+    }
+
+    acc = AABB();
+    count = 0;
+    for (int b = 0; b < num_bins - 1; ++b) {
+      acc.expand(axis_bins[b].bounds);
+      count += axis_bins[b].count;
+      if (count == 0 || right_count[b + 1] == 0) continue;
+
+      float cost = config.traversal_cost +
+                   config.intersection_cost * inv_area *
+                       (count * acc.surface_area() +
+                        right_count[b + 1] * right_area[b + 1]);
+      if (cost < best.cost) {
+        best.axis = axis;
+        best.bin = b;
+        best.cost = cost;
+      }
+    }
+  }
+  return best;
+}
+
+// Must be called from inside a parallel region (or serially); large
+// subtrees are handed to OpenMP tasks of the enclosing team.
+inline BvhBuildNode* recursive_build(std::vector<BvhPrimitiveInfo>& infos,
+                                     int start, int end,
+                                     const BvhBuildConfig& config,
+                                     BvhNodeArena& arena, int depth = 0) {
+  BvhBuildNode* node = arena.alloc();
+  AABB bounds;
+  AABB centroid_bounds;
+  compute_bounds(infos, start, end, bounds, centroid_bounds);
+
+  int num_primitives = end - start;
+  if (num_primitives == 1) {
+    node->init_leaf(start, num_primitives, bounds);
+    return node;
+  }
 
   if (centroid_bounds.x.max == centroid_bounds.x.min &&
       centroid_bounds.y.max == centroid_bounds.y.min &&
@@ -76,59 +299,477 @@ BvhBuildNode* recursive_build(std::vector<T>& objects,
     return node;
   }
 
-  std::nth_element(&objects[start], &objects[mid], &objects[end - 1] + 1,
-                   [dim](const T& a,
-                         const T& b) {
-                     return a.get_aabb().centroid()[dim] <
-                            b.get_aabb().centroid()[dim];
-                   });
-  node->init_interior(dim, recursive_build(objects, start, mid),
-                      recursive_build(objects, mid, end));
+  int dim = centroid_bounds.longest_axis();
+  int mid = (start + end) / 2;
+  bool partitioned = false;
+
+  if (config.split_method != BvhSplitMethod::Median &&
+      !bvh_depth_exhausted(depth, num_primitives)) {
+    BvhSplit split = find_sah_split(infos, start, end, bounds,
+                                    centroid_bounds, config);
+    float leaf_cost = config.intersection_cost * num_primitives;
+    if (num_primitives <= config.max_leaf_size && split.cost >= leaf_cost) {
+      node->init_leaf(start, num_primitives, bounds);
+      return node;
+    }
+
+    if (split.axis >= 0) {
+      const int num_bins = std::clamp(config.num_bins, 2, kMaxBvhBins);
+      dim = split.axis;
+      BvhPrimitiveInfo* pmid = std::partition(
+          &infos[start], &infos[end - 1] + 1,
+          [&](const BvhPrimitiveInfo& p) {
+            return bvh_bin_index(centroid_bounds, dim, num_bins,
+                                 p.centroid) <= split.bin;
+          });
+      mid = static_cast<int>(pmid - &infos[0]);
+      partitioned = mid != start && mid != end;
+    }
+  }
+
+  if (!partitioned) {
+    dim = centroid_bounds.longest_axis();
+    mid = (start + end) / 2;
+    std::nth_element(&infos[start], &infos[mid], &infos[end - 1] + 1,
+                     [dim](const BvhPrimitiveInfo& a,
+                           const BvhPrimitiveInfo& b) {
+                       return a.centroid[dim] < b.centroid[dim];
+                     });
+  }
+
+  BvhBuildNode* left = nullptr;
+  BvhBuildNode* right = nullptr;
+  if (num_primitives > kParallelBuildThreshold) {
+#pragma omp task shared(infos, config, arena, left)
+    left = recursive_build(infos, start, mid, config, arena, depth + 1);
+    right = recursive_build(infos, mid, end, config, arena, depth + 1);
+#pragma omp taskwait
+  } else {
+    left = recursive_build(infos, start, mid, config, arena, depth + 1);
+    right = recursive_build(infos, mid, end, config, arena, depth + 1);
+  }
+  node->init_interior(dim, left, right);
   return node;
 }
 
+// Primitive types that can be clipped to a plane, as spatial splits need.
+// clip() returns the parts of the primitive on either side of the plane
+// `position` on `axis`, limited to `bounds`.
+template <typename T>
+concept SpatiallySplittable =
+    requires(const T& t, int axis, float position, const AABB& bounds,
+             AABB& left, AABB& right) {
+      t.clip(axis, position, bounds, left, right);
+    };
+
+struct SbvhBuildState {
+  float min_overlap_area = 0.0f;
+  int max_references = 0;
+  std::atomic<int> num_references{0};
+  // Set once a reference has been split into two, after which leaves no
+  // longer hold a permutation of the objects.
+  std::atomic<bool> references_split{false};
+  // Leaves append their references here, so each leaf gets a contiguous
+  // range even though references are duplicated.
+  std::mutex leaf_mutex;
+  std::vector<BvhPrimitiveInfo> leaf_references;
+};
+
+struct SbvhSpatialSplit {
+  int axis = -1;
+  float position = 0.0f;
+  float cost = INFINITY;
+};
+
+template <SpatiallySplittable T>
+SbvhSpatialSplit find_spatial_split(
+    const std::vector<T>& objects,
+    const std::vector<BvhPrimitiveInfo>& refs, const AABB& bounds,
+    const BvhBuildConfig& config) {
+  const int num_bins = std::clamp(config.num_bins, 2, kMaxBvhBins);
+  const float inv_area = 1.0f / bounds.surface_area();
+  SbvhSpatialSplit best;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    const Interval& extent = bounds[axis];
+    float bin_width = extent.getLength() / num_bins;
+    if (bin_width <= 0.0f) continue;
+
+    std::array<AABB, kMaxBvhBins> bin_bounds;
+    std::array<int, kMaxBvhBins> entries{};
+    std::array<int, kMaxBvhBins> exits{};
+    auto bin_of = [&](float v) {
+      return std::clamp(static_cast<int>((v - extent.min) / bin_width), 0,
+                        num_bins - 1);
+    };
+
+    // Chop every reference at the bin planes it crosses.
+    for (const BvhPrimitiveInfo& ref : refs) {
+      int first = bin_of(ref.bounds[axis].min);
+      int last = bin_of(ref.bounds[axis].max);
+      AABB rest = ref.bounds;
+      for (int b = first; b < last; ++b) {
+        AABB left, right;
+        objects[ref.index].clip(axis, extent.min + (b + 1) * bin_width, rest,
+                                left, right);
+        bin_bounds[b].expand(left);
+        rest = right;
+      }
+      bin_bounds[last].expand(rest);
+      entries[first]++;
+      exits[last]++;
+    }
+
+    std::array<float, kMaxBvhBins> right_area;
+    std::array<int, kMaxBvhBins> right_count;
+    AABB acc;
+    int count = 0;
+    for (int b = num_bins - 1; b > 0; --b) {
+      acc.expand(bin_bounds[b]);
+      count += exits[b];
+      right_area[b] = acc.is_empty() ? 0.0f : acc.surface_area();
+      right_count[b] = count;
+    }
+
+    acc = AABB();
+    count = 0;
+    for (int b = 0; b < num_bins - 1; ++b) {
+      acc.expand(bin_bounds[b]);
+      count += entries[b];
+      if (count == 0 || right_count[b + 1] == 0) continue;
+
+      float cost = config.traversal_cost +
+                   config.intersection_cost * inv_area *
+                       (count * acc.surface_area() +
+                        right_count[b + 1] * right_area[b + 1]);
+      if (cost < best.cost) {
+        best.axis = axis;
+        best.position = extent.min + (b + 1) * bin_width;
+        best.cost = cost;
+      }
+    }
+  }
+  return best;
+}
+
+inline BvhBuildNode* make_sbvh_leaf(std::vector<BvhPrimitiveInfo>& refs,
+                                    const AABB& bounds, BvhNodeArena& arena,
+                                    SbvhBuildState& state) {
+  BvhBuildNode* node = arena.alloc();
+  std::lock_guard<std::mutex> lock(state.leaf_mutex);
+  int first = static_cast<int>(state.leaf_references.size());
+  state.leaf_references.insert(state.leaf_references.end(), refs.begin(),
+                               refs.end());
+  node->init_leaf(first, static_cast<int>(refs.size()), bounds);
+  return node;
+}
+
+// Like recursive_build, but each node owns its references since spatial
+// splits change their number.
+template <SpatiallySplittable T>
+BvhBuildNode* spatial_recursive_build(const std::vector<T>& objects,
+                                      std::vector<BvhPrimitiveInfo> refs,
+                                      const BvhBuildConfig& config,
+                                      BvhNodeArena& arena,
+                                      SbvhBuildState& state, int depth = 0) {
+  const int n = static_cast<int>(refs.size());
+  AABB bounds;
+  AABB centroid_bounds;
+  compute_bounds(refs, 0, n, bounds, centroid_bounds);
+  if (n == 1) return make_sbvh_leaf(refs, bounds, arena, state);
+
+  // Without SAH splits the centroid median fallback below splits the node.
+  const bool depth_exhausted = bvh_depth_exhausted(depth, n);
+  const int num_bins = std::clamp(config.num_bins, 2, kMaxBvhBins);
+  BvhSplit object_split;
+  if (!depth_exhausted) {
+    object_split = find_sah_split(refs, 0, n, bounds, centroid_bounds, config);
+  }
+
+  // Overlap of the object split's children decides whether spatial splits
+  // are worth evaluating.
+  float overlap = 0.0f;
+  if (object_split.axis >= 0) {
+    AABB left, right;
+    for (const BvhPrimitiveInfo& ref : refs) {
+      int b = bvh_bin_index(centroid_bounds, object_split.axis, num_bins,
+                            ref.centroid);
+      (b <= object_split.bin ? left : right).expand(ref.bounds);
+    }
+    AABB common = left.intersection(right);
+    overlap = common.is_empty() ? 0.0f : common.surface_area();
+  }
+
+  SbvhSpatialSplit spatial_split;
+  if (!depth_exhausted &&
+      (object_split.axis < 0 || overlap > state.min_overlap_area) &&
+      state.num_references.load() < state.max_references) {
+    spatial_split = find_spatial_split(objects, refs, bounds, config);
+  }
+
+  float best_cost = std::min(object_split.cost, spatial_split.cost);
+  if (n <= config.max_leaf_size &&
+      best_cost >= config.intersection_cost * n) {
+    return make_sbvh_leaf(refs, bounds, arena, state);
+  }
+
+  std::vector<BvhPrimitiveInfo> left_refs;
+  std::vector<BvhPrimitiveInfo> right_refs;
+  int dim = 0;
+  if (spatial_split.cost < object_split.cost) {
+    dim = spatial_split.axis;
+    const float position = spatial_split.position;
+    for (const BvhPrimitiveInfo& ref : refs) {
+      if (ref.bounds[dim].max <= position) {
+        left_refs.push_back(ref);
+      } else if (ref.bounds[dim].min >= position) {
+        right_refs.push_back(ref);
+      } else if (state.num_references.load() >= state.max_references) {
+        // Out of budget: keep the reference whole on its centroid's side.
+        (ref.centroid[dim] < position ? left_refs : right_refs).push_back(ref);
+      } else {
+        AABB left, right;
+        objects[ref.index].clip(dim, position, ref.bounds, left, right);
+        if (left.is_empty() && right.is_empty()) {
+          // Clipped reference bounds are only conservative, so the
+          // primitive may miss the plane on both sides. Keep it whole, as
+          // out of budget, rather than lose it.
+          (ref.centroid[dim] < position ? left_refs : right_refs).push_back(ref);
+          continue;
+        }
+        if (!left.is_empty()) {
+          left_refs.push_back({left, left.centroid(), ref.index});
+        }
+        if (!right.is_empty()) {
+          right_refs.push_back({right, right.centroid(), ref.index});
+        }
+        if (!left.is_empty() && !right.is_empty()) {
+          state.num_references++;
+          state.references_split.store(true, std::memory_order_relaxed);
+        }
+      }
+    }
+  } else if (object_split.axis >= 0) {
+    dim = object_split.axis;
+    for (const BvhPrimitiveInfo& ref : refs) {
+      int b = bvh_bin_index(centroid_bounds, dim, num_bins, ref.centroid);
+      (b <= object_split.bin ? left_refs : right_refs).push_back(ref);
+    }
+  }
+
+  if (left_refs.empty() || right_refs.empty()) {
+    // No usable split; fall back to the centroid median like the object
+    // builder, or give up on identical centroids.
+    if (centroid_bounds.x.max > centroid_bounds.x.min ||
+        centroid_bounds.y.max > centroid_bounds.y.min ||
+        centroid_bounds.z.max > centroid_bounds.z.min) {
+      dim = centroid_bounds.longest_axis();
+      int mid = n / 2;
+      std::nth_element(refs.begin(), refs.begin() + mid, refs.end(),
+                       [dim](const BvhPrimitiveInfo& a,
+                             const BvhPrimitiveInfo& b) {
+                         return a.centroid[dim] < b.centroid[dim];
+                       });
+      left_refs.assign(refs.begin(), refs.begin() + mid);
+      right_refs.assign(refs.begin() + mid, refs.end());
+    } else {
+      return make_sbvh_leaf(refs, bounds, arena, state);
+    }
+  }
+  refs.clear();
+  refs.shrink_to_fit();
+
+  BvhBuildNode* node = arena.alloc();
+  BvhBuildNode* left = nullptr;
+  BvhBuildNode* right = nullptr;
+  if (n > kParallelBuildThreshold) {
+#pragma omp task shared(objects, left_refs, config, arena, state, left)
+    left = spatial_recursive_build(objects, std::move(left_refs), config,
+                                   arena, state, depth + 1);
+    right = spatial_recursive_build(objects, std::move(right_refs), config,
+                                    arena, state, depth + 1);
+#pragma omp taskwait
+  } else {
+    left = spatial_recursive_build(objects, std::move(left_refs), config,
+                                   arena, state, depth + 1);
+    right = spatial_recursive_build(objects, std::move(right_refs), config,
+                                    arena, state, depth + 1);
+  }
+  node->init_interior(dim, left, right);
+  return node;
+}
+
+// Shape and size of a built BVH, from BVH::stats().
+struct BvhStats {
+  static constexpr int kLeafHistogramSize = 17;
+
+  int num_nodes = 0;
+  int num_wide_nodes = 0;
+  int num_leaves = 0;
+  int max_depth = 0;
+  float average_leaf_depth = 0.0f;
+  // leaf_sizes[n] counts leaves with n primitives; the last bucket also
+  // counts larger leaves. Packed BVHs count packets.
+  std::array<int, kLeafHistogramSize> leaf_sizes{};
+  float sah_cost = 0.0f;
+  size_t memory_bytes = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const BvhStats& stats) {
+  os << stats.num_nodes << " nodes";
+  if (stats.num_wide_nodes > 0) os << " (" << stats.num_wide_nodes << " wide)";
+  os << ", " << stats.num_leaves << " leaves, depth " << stats.max_depth
+     << " (leaf avg " << stats.average_leaf_depth << "), SAH cost "
+     << stats.sah_cost << ", " << stats.memory_bytes / 1024 << " KiB, leaf sizes";
+  int last = BvhStats::kLeafHistogramSize - 1;
+  while (last > 0 && stats.leaf_sizes[last] == 0) --last;
+  for (int n = 1; n <= last; ++n) {
+    os << " " << n << (n == BvhStats::kLeafHistogramSize - 1 ? "+:" : ":")
+       << stats.leaf_sizes[n];
+  }
+  return os;
+}
+
 template <typename T>
 class BVH {
  public:
   BVH() = default;
 
-  void build(std::vector<T>& objects) {
-    if (objects.empty()) return;
+  // Takes ownership of the primitives and reorders them in place into leaf
+  // order, so no second copy is made.
+  void build(std::vector<T>&& objects,
+             const BvhBuildConfig& config = BvhBuildConfig()) {
+    external_ = nullptr;
+    prim_indices_.clear();
+    bool references_split = false;
+    std::vector<BvhPrimitiveInfo> infos =
+        build_nodes(objects, config, &references_split);
+    if (references_split) {
+      // Spatial splits duplicated references, so leaves need copies.
+      primitives_.clear();
+      primitives_.reserve(infos.size());
+      for (const BvhPrimitiveInfo& info : infos) {
+        primitives_.push_back(objects[info.index]);
+      }
+      return;
+    }
 
-    primitives_ = objects;
-    BvhBuildNode* root = recursive_build(primitives_, 0, primitives_.size());
+    // Apply the leaf order permutation cycle by cycle; infos[i].index is
+    // the object that belongs at position i.
+    std::vector<int> order(infos.size());
+    for (size_t i = 0; i < infos.size(); ++i) order[i] = infos[i].index;
+    for (int i = 0; i < static_cast<int>(order.size()); ++i) {
+      if (order[i] == i || order[i] < 0) continue;
+      T held = std::move(objects[i]);
+      int j = i;
+      while (order[j] != i) {
+        int next = order[j];
+        objects[j] = std::move(objects[next]);
+        order[j] = -1;
+        j = next;
+      }
+      objects[j] = std::move(held);
+      order[j] = -1;
+    }
+    primitives_ = std::move(objects);
+  }
 
-    nodes_.resize(primitives_.size() * 2);
-    int offset = 0;
-    flatten_bvh_tree(root, &offset);
-    nodes_.resize(offset);
+  // Keeps only a permutation into the elements of `objects`. They must not
+  // be reallocated or modified while the BVH is used; moving the vector
+  // itself is fine.
+  void build_indexed(const std::vector<T>& objects,
+                     const BvhBuildConfig& config = BvhBuildConfig()) {
+    primitives_.clear();
+    std::vector<BvhPrimitiveInfo> infos = build_nodes(objects, config);
+    external_ = objects.data();
+    prim_indices_.resize(infos.size());
+    for (size_t i = 0; i < infos.size(); ++i) {
+      prim_indices_[i] = infos[i].index;
+    }
   }
 
   bool intersect(Ray& ray, HitRecord& rec) const {
+    return traverse(ray, [&](int first, int count, Ray& r) {
+      bool hit = false;
+      for (int i = first; i < first + count; ++i) {
+        if (primitive(i).intersect(r, rec)) {
+          hit = true;
+          r.t_max = rec.t;
+        }
+      }
+      return hit;
+    });
+  }
+
+  bool is_occluded(const Ray& ray) const {
+    return traverse_any(ray, [&](int first, int count, const Ray& r) {
+      for (int i = first; i < first + count; ++i) {
+        if (primitive(i).occluded(r)) return true;
+      }
+      return false;
+    });
+  }
+
+  // Packet versions of intersect and is_occluded for the rays in `mask`;
+  // they return the rays that hit.
+  uint32_t intersect_packet(RayPacket& packet, uint32_t mask,
+                            HitRecord* recs) const {
+    return traverse_packet(
+        packet, mask,
+        [&](int first, int count, RayPacket& p, uint32_t leaf_mask) {
+          uint32_t hit = 0;
+          for (int i = first; i < first + count; ++i) {
+            hit |= primitive(i).intersect_packet(p, leaf_mask, recs);
+          }
+          return hit;
+        });
+  }
+
+  uint32_t is_occluded_packet(const RayPacket& packet, uint32_t mask) const {
+    return traverse_any_packet(
+        packet, mask,
+        [&](int first, int count, const RayPacket& p, uint32_t leaf_mask) {
+          uint32_t occluded = 0;
+          for (int i = first; i < first + count && leaf_mask; ++i) {
+            uint32_t o = primitive(i).occluded_packet(p, leaf_mask);
+            occluded |= o;
+            leaf_mask &= ~o;
+          }
+          return occluded;
+        });
+  }
+
+  // Closest-hit traversal that hands each reached leaf's range to
+  // `intersect_leaf(first, count, ray)`. On a hit the callback returns true
+  // and shrinks ray.t_max to it.
+  template <typename LeafFn>
+  bool traverse(Ray& ray, LeafFn&& intersect_leaf) const {
     if (nodes_.empty()) return false;
+    if (!wide_nodes_.empty()) return traverse_wide(ray, intersect_leaf);
 
+    TraversalRecorder record;
     bool hit = false;
     int to_visit_offset = 0;
     int current_node_index = 0;
-    int nodes_to_visit[64];
+    int nodes_to_visit[kMaxBvhDepth];
 
     while (true) {
       const LinearBvhNode* node = &nodes_[current_node_index];
 
-      if (node->bbox.intersect(ray)) {
+      ++record.nodes;
+      if (node_intersects(current_node_index, ray)) {
         if (node->num_primitives > 0) {
           // Leaf node
-          for (int i = 0; i < node->num_primitives; i++) {
-            if (primitives_[node->primitives_offset + i].intersect(ray, rec)) {
-              hit = true;
-              ray.t_max = rec.t;
-            }
+          record.tests += node->num_primitives;
+          if (intersect_leaf(node->primitives_offset, node->num_primitives,
+                             ray)) {
+            hit = true;
           }
           if (to_visit_offset == 0) break;
           current_node_index = nodes_to_visit[--to_visit_offset];
         } else {
           // Heuristic (choose the one which is closer to the ray)
-          if (ray.direction[node->axis] > 0) {
+          if (!ray.sign[node->axis]) {
             nodes_to_visit[to_visit_offset++] = node->second_child_offset;
             current_node_index = current_node_index + 1;
           } else {
@@ -144,33 +785,35 @@ class BVH {
     return hit;
   }
 
-  bool is_occluded(const Ray& ray) const {
+  // Any-hit traversal; stops at the first leaf for which
+  // `occluded_leaf(first, count, ray)` returns true.
+  template <typename LeafFn>
+  bool traverse_any(const Ray& ray, LeafFn&& occluded_leaf) const {
     if (nodes_.empty()) return false;
+    if (!wide_nodes_.empty()) return traverse_any_wide(ray, occluded_leaf);
 
-    Ray shadow_ray = ray;
-
+    TraversalRecorder record;
     int to_visit_offset = 0;
     int current_node_index = 0;
-    int nodes_to_visit[64];
+    int nodes_to_visit[kMaxBvhDepth];
 
     while (true) {
       const LinearBvhNode* node = &nodes_[current_node_index];
 
-      if (node->bbox.intersect(shadow_ray)) {
+      ++record.nodes;
+      if (node_intersects(current_node_index, ray)) {
         if (node->num_primitives > 0) {
           // Leaf
-          for (int i = 0; i < node->num_primitives; ++i) {
-            HitRecord temp_rec;
-            if (primitives_[node->primitives_offset + i].intersect(shadow_ray,
-                                                                    temp_rec)) {
-              return true;
-            }
+          record.tests += node->num_primitives;
+          if (occluded_leaf(node->primitives_offset, node->num_primitives,
+                            ray)) {
+            return true;
           }
           if (to_visit_offset == 0) break;
           current_node_index = nodes_to_visit[--to_visit_offset];
         } else {
           // Interior node
-          if (shadow_ray.direction[node->axis] > 0) {
+          if (!ray.sign[node->axis]) {
             nodes_to_visit[to_visit_offset++] = node->second_child_offset;
             current_node_index = current_node_index + 1;
           } else {
@@ -186,13 +829,701 @@ class BVH {
     return false;
   }
 
+  // Closest-hit traversal of the rays of `packet` in `mask` that visits each
+  // node once for all of them (see PacketRays::cull). Each reached leaf is
+  // handed to `intersect_leaf(first, count, packet, leaf_mask)`, which
+  // returns the rays of leaf_mask it hit and shrinks their t_max. Packets
+  // that cannot share node tests, or too few rays to amortize them, fall
+  // back to traverse() per ray.
+  template <typename LeafFn>
+  uint32_t traverse_packet(RayPacket& packet, uint32_t mask,
+                           LeafFn&& intersect_leaf) const {
+    if (nodes_.empty() || mask == 0) return 0;
+    uint32_t hit = 0;
+    if (std::popcount(mask) < kMinPacketRays || !packet.is_coherent(mask)) {
+      for_each_ray(mask, [&](int i) {
+        uint32_t bit = 1u << i;
+        if (traverse(packet.rays[i], [&](int first, int count, Ray&) {
+              return intersect_leaf(first, count, packet, bit) != 0;
+            })) {
+          hit |= bit;
+        }
+      });
+      return hit;
+    }
+
+    if (!wide_nodes_.empty()) {
+      return traverse_packet_wide(packet, mask, intersect_leaf);
+    }
+
+    TraversalRecorder record;
+    PacketRays packet_rays(packet, mask);
+    PacketStackEntry stack[kPacketStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = {0, mask};
+
+    while (stack_size > 0) {
+      const PacketStackEntry entry = stack[--stack_size];
+      const LinearBvhNode& node = nodes_[entry.index];
+      ++record.nodes;
+
+      if (node.num_primitives > 0) {
+        // Leaves get the exact ray set, so no ray tests primitives whose
+        // box it misses.
+        uint32_t leaf_mask = packet_rays.intersect(
+            node.bbox, motion_end_bound(entry.index), entry.mask);
+        if (leaf_mask == 0) continue;
+        record.tests += node.num_primitives * std::popcount(leaf_mask);
+        uint32_t leaf_hit = intersect_leaf(node.primitives_offset,
+                                           node.num_primitives, packet,
+                                           leaf_mask);
+        if (leaf_hit) {
+          hit |= leaf_hit;
+          packet_rays.update_t_max();
+        }
+        continue;
+      }
+
+      uint32_t node_mask = packet_rays.cull(
+          node.bbox, motion_end_bound(entry.index), entry.mask);
+      if (node_mask == 0) continue;
+      // All rays share the direction octant, so one order suits them all.
+      int near = entry.index + 1;
+      int far = node.second_child_offset;
+      if (packet.rays[std::countr_zero(node_mask)].sign[node.axis]) {
+        std::swap(near, far);
+      }
+      stack[stack_size++] = {far, node_mask};
+      stack[stack_size++] = {near, node_mask};
+    }
+    return hit;
+  }
+
+  // Any-hit counterpart of traverse_packet: `occluded_leaf(first, count,
+  // packet, leaf_mask)` returns the rays found occluded, which then leave
+  // the traversal; it ends once no ray is left.
+  template <typename LeafFn>
+  uint32_t traverse_any_packet(const RayPacket& packet, uint32_t mask,
+                               LeafFn&& occluded_leaf) const {
+    if (nodes_.empty() || mask == 0) return 0;
+    uint32_t occluded = 0;
+    if (std::popcount(mask) < kMinPacketRays || !packet.is_coherent(mask)) {
+      for_each_ray(mask, [&](int i) {
+        uint32_t bit = 1u << i;
+        if (traverse_any(packet.rays[i], [&](int first, int count,
+                                             const Ray&) {
+              return occluded_leaf(first, count, packet, bit) != 0;
+            })) {
+          occluded |= bit;
+        }
+      });
+      return occluded;
+    }
+
+    if (!wide_nodes_.empty()) {
+      return traverse_any_packet_wide(packet, mask, occluded_leaf);
+    }
+
+    TraversalRecorder record;
+    PacketRays packet_rays(packet, mask);
+    PacketStackEntry stack[kPacketStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = {0, mask};
+
+    while (stack_size > 0) {
+      const PacketStackEntry entry = stack[--stack_size];
+      uint32_t active = entry.mask & ~occluded;
+      if (active == 0) continue;
+      const LinearBvhNode& node = nodes_[entry.index];
+      ++record.nodes;
+
+      if (node.num_primitives > 0) {
+        uint32_t leaf_mask = packet_rays.intersect(
+            node.bbox, motion_end_bound(entry.index), active);
+        if (leaf_mask == 0) continue;
+        record.tests += node.num_primitives * std::popcount(leaf_mask);
+        occluded |= occluded_leaf(node.primitives_offset, node.num_primitives,
+                                  packet, leaf_mask);
+        if (occluded == mask) break;
+        continue;
+      }
+
+      uint32_t node_mask = packet_rays.cull(
+          node.bbox, motion_end_bound(entry.index), active);
+      if (node_mask == 0) continue;
+      stack[stack_size++] = {node.second_child_offset, node_mask};
+      stack[stack_size++] = {entry.index + 1, node_mask};
+    }
+    return occluded;
+  }
+
+  // Replaces every leaf range by `pack(primitives, count)`, which returns
+  // the new {first, count} pair, and releases the primitives. Lets the
+  // owner store leaves in its own packed format; afterwards only
+  // traverse() and traverse_any() are meaningful.
+  template <typename PackFn>
+  void pack_leaves(PackFn&& pack) {
+    std::vector<std::pair<int, int>> packed(primitives_.size());
+    for (LinearBvhNode& node : nodes_) {
+      if (node.num_primitives == 0) continue;
+      std::pair<int, int> range =
+          pack(&primitives_[node.primitives_offset], node.num_primitives);
+      packed[node.primitives_offset] = range;
+      node.primitives_offset = range.first;
+      node.num_primitives = static_cast<uint16_t>(range.second);
+    }
+    for (WideBvhNode& node : wide_nodes_) {
+      for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+        if (node.is_empty(lane) || !node.is_leaf(lane)) continue;
+        const std::pair<int, int>& range = packed[node.child[lane]];
+        node.child[lane] = range.first;
+        node.num_primitives[lane] = static_cast<uint16_t>(range.second);
+      }
+    }
+    primitives_.clear();
+    primitives_.shrink_to_fit();
+  }
+
   AABB get_root_aabb() const { return nodes_[0].bbox; }
 
+  BvhStats stats() const {
+    BvhStats stats;
+    stats.num_nodes = static_cast<int>(nodes_.size());
+    stats.num_wide_nodes = static_cast<int>(wide_nodes_.size());
+    stats.sah_cost = sah_cost_;
+    stats.memory_bytes =
+        nodes_.capacity() * sizeof(LinearBvhNode) +
+        wide_nodes_.capacity() * sizeof(WideBvhNode) +
+        motion_end_bounds_.capacity() * sizeof(AABB) +
+        wide_motion_.capacity() * sizeof(WideMotionBounds) +
+        primitives_.capacity() * sizeof(T) +
+        prim_indices_.capacity() * sizeof(int);
+    if (nodes_.empty()) return stats;
+
+    // Children follow their parent, so depths fill in a forward pass.
+    std::vector<int> depth(nodes_.size(), 0);
+    int64_t leaf_depth_sum = 0;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      const LinearBvhNode& node = nodes_[i];
+      stats.max_depth = std::max(stats.max_depth, depth[i]);
+      if (node.num_primitives > 0) {
+        ++stats.num_leaves;
+        leaf_depth_sum += depth[i];
+        ++stats.leaf_sizes[std::min<int>(node.num_primitives,
+                                         BvhStats::kLeafHistogramSize - 1)];
+      } else {
+        depth[i + 1] = depth[i] + 1;
+        depth[node.second_child_offset] = depth[i] + 1;
+      }
+    }
+    stats.average_leaf_depth =
+        static_cast<float>(leaf_depth_sum) / stats.num_leaves;
+    return stats;
+  }
+
+  // Flattened node arrays, e.g. for writing a packed BVH to disk.
+  const std::vector<LinearBvhNode>& nodes() const { return nodes_; }
+  const std::vector<WideBvhNode>& wide_nodes() const { return wide_nodes_; }
+
+  // Installs node arrays saved from a static BVH after pack_leaves, whose
+  // leaves index storage kept by the caller, along with the config it was
+  // built with.
+  void restore(std::vector<LinearBvhNode> nodes,
+               std::vector<WideBvhNode> wide_nodes,
+               const BvhBuildConfig& config, float sah_cost) {
+    nodes_ = std::move(nodes);
+    wide_nodes_ = std::move(wide_nodes);
+    config_ = config;
+    sah_cost_ = sah_cost;
+    motion_end_bounds_.clear();
+    wide_motion_.clear();
+    primitives_.clear();
+    external_ = nullptr;
+    prim_indices_.clear();
+  }
+
+  // Recomputes node bounds bottom-up after primitives moved or deformed,
+  // keeping the tree. Its quality drops as primitives drift from where they
+  // were at build time, so callers compare sah_cost() against the built
+  // cost to decide when to rebuild instead. leaf_bounds(first, count)
+  // returns the bounds of a leaf's range, which is how packed BVHs refit.
+  template <typename LeafBoundsFn>
+  void refit(LeafBoundsFn&& leaf_bounds) {
+    if (nodes_.empty()) return;
+    // Children always follow their parent in the flattened order.
+    for (int i = static_cast<int>(nodes_.size()) - 1; i >= 0; --i) {
+      LinearBvhNode& node = nodes_[i];
+      if (node.num_primitives > 0) {
+        node.bbox = leaf_bounds(node.primitives_offset, node.num_primitives);
+      } else {
+        node.bbox = nodes_[i + 1].bbox;
+        node.bbox.expand(nodes_[node.second_child_offset].bbox);
+      }
+    }
+    motion_end_bounds_.clear();
+    sah_cost_ = compute_sah_cost(config_);
+    build_wide_nodes(wide_nodes_.empty() ? BvhLayout::Binary
+                                         : BvhLayout::Wide4);
+  }
+
+  // Refit from the primitives' own bounds; not for packed BVHs.
+  void refit() {
+    if (nodes_.empty()) return;
+    if constexpr (requires(const T& t) { t.get_aabb_at(0.0f); }) {
+      bool any_motion = false;
+      for (int i = 0; i < num_primitives(); ++i) {
+        any_motion |= primitive(i).has_motion();
+      }
+      if (any_motion) {
+        compute_motion_bounds([this](int i) -> const T& {
+          return primitive(i);
+        });
+        sah_cost_ = compute_sah_cost(config_);
+        build_wide_nodes(wide_nodes_.empty() ? BvhLayout::Binary
+                                             : BvhLayout::Wide4);
+        return;
+      }
+    }
+    refit([this](int first, int count) {
+      AABB bounds;
+      for (int i = first; i < first + count; ++i) {
+        bounds.expand(primitive(i).get_aabb());
+      }
+      return bounds;
+    });
+  }
+
+  // Expected cost of a random ray under the build cost model, relative to
+  // hitting the root box.
+  float sah_cost() const { return sah_cost_; }
+  const BvhBuildConfig& config() const { return config_; }
+
  private:
   std::vector<LinearBvhNode> nodes_;
+  std::vector<WideBvhNode> wide_nodes_;
+  // Bounds at shutter time 1 when primitives move; node bounds then hold
+  // time 0. Empty for static BVHs.
+  std::vector<AABB> motion_end_bounds_;
+  std::vector<WideMotionBounds> wide_motion_;
+  // Owned primitives in leaf order, or empty when the BVH indexes into
+  // caller storage through prim_indices_.
   std::vector<T> primitives_;
+  const T* external_ = nullptr;
+  std::vector<int> prim_indices_;
+
+  int num_primitives() const {
+    return static_cast<int>(external_ ? prim_indices_.size()
+                                      : primitives_.size());
+  }
+
+  const T& primitive(int i) const {
+    return external_ ? external_[prim_indices_[i]] : primitives_[i];
+  }
+
+  BvhBuildConfig config_;
+  float sah_cost_ = 0.0f;
+
+  // A wide node pushes at most three more entries than it pops, so this
+  // covers trees deeper than the binary traversal stack allows.
+  static constexpr int kWideStackSize = 256;
+  // One entry per level plus the far child of the current node.
+  static constexpr int kPacketStackSize = kMaxBvhDepth + 1;
+  // Below this many rays a packet traversal costs more than tracing the
+  // rays one at a time through the wide nodes.
+  static constexpr int kMinPacketRays = 4;
+
+  struct PacketStackEntry {
+    int index;
+    uint32_t mask;
+  };
+
+  // Leaf entries carry their primitive count; interior entries have zero.
+  struct WideStackEntry {
+    int index;
+    int num_primitives;
+    float t_near;
+  };
+
+  // Pushes the hit lanes of `node` far to near so the nearest is popped
+  // first.
+  static void push_wide_children(const WideBvhNode& node, int mask,
+                                 const float t_near[kWideBvhWidth],
+                                 WideStackEntry* stack, int& stack_size) {
+    WideStackEntry hits[kWideBvhWidth];
+    int num_hits = 0;
+    for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+      if (!(mask & (1 << lane)) || node.is_empty(lane)) continue;
+      WideStackEntry entry{node.child[lane], node.num_primitives[lane],
+                           t_near[lane]};
+      int i = num_hits++;
+      while (i > 0 && hits[i - 1].t_near < entry.t_near) {
+        hits[i] = hits[i - 1];
+        --i;
+      }
+      hits[i] = entry;
+    }
+    for (int i = 0; i < num_hits; ++i) stack[stack_size++] = hits[i];
+  }
+
+  // `root` lets packet traversals finish a subtree one ray at a time.
+  template <typename LeafFn>
+  bool traverse_wide(Ray& ray, LeafFn& intersect_leaf, int root = 0) const {
+    TraversalRecorder record;
+    WideRay wide_ray(ray);
+    WideStackEntry stack[kWideStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = {root, 0, ray.t_min};
+    bool hit = false;
+    float t_near[kWideBvhWidth];
+
+    while (stack_size > 0) {
+      const WideStackEntry entry = stack[--stack_size];
+      // The entry was pushed before a closer hit may have been found.
+      if (entry.t_near > ray.t_max) continue;
+
+      if (entry.num_primitives > 0) {
+        record.tests += entry.num_primitives;
+        if (intersect_leaf(entry.index, entry.num_primitives, ray)) {
+          hit = true;
+        }
+        continue;
+      }
+
+      ++record.nodes;
+      const WideBvhNode& node = wide_nodes_[entry.index];
+      int mask = intersect_wide_node(node, wide_motion(entry.index), wide_ray,
+                                     t_near);
+      push_wide_children(node, mask, t_near, stack, stack_size);
+    }
+    return hit;
+  }
+
+  template <typename LeafFn>
+  bool traverse_any_wide(const Ray& ray, LeafFn& occluded_leaf,
+                         int root = 0) const {
+    TraversalRecorder record;
+    WideRay wide_ray(ray);
+    WideStackEntry stack[kWideStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = {root, 0, ray.t_min};
+    float t_near[kWideBvhWidth];
+
+    while (stack_size > 0) {
+      const WideStackEntry entry = stack[--stack_size];
+      if (entry.num_primitives > 0) {
+        record.tests += entry.num_primitives;
+        if (occluded_leaf(entry.index, entry.num_primitives, ray)) {
+          return true;
+        }
+        continue;
+      }
+
+      // Any hit ends the query, so children are not sorted.
+      ++record.nodes;
+      const WideBvhNode& node = wide_nodes_[entry.index];
+      int mask = intersect_wide_node(node, wide_motion(entry.index), wide_ray,
+                                     t_near);
+      for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+        if (!(mask & (1 << lane)) || node.is_empty(lane)) continue;
+        stack[stack_size++] = {node.child[lane], node.num_primitives[lane],
+                               t_near[lane]};
+      }
+    }
+    return false;
+  }
+
+  struct PacketWideStackEntry {
+    int index;
+    int num_primitives;
+    uint32_t mask;
+  };
+
+  template <typename LeafFn>
+  uint32_t traverse_packet_wide(RayPacket& packet, uint32_t mask,
+                                LeafFn& intersect_leaf) const {
+    TraversalRecorder record;
+    PacketRays packet_rays(packet, mask);
+    PacketWideStackEntry stack[kWideStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = {0, 0, mask};
+    uint32_t hit = 0;
+    uint32_t lane_masks[kWideBvhWidth];
+    float t_near[kWideBvhWidth];
+
+    while (stack_size > 0) {
+      const PacketWideStackEntry entry = stack[--stack_size];
+      if (entry.num_primitives > 0) {
+        record.tests += entry.num_primitives * std::popcount(entry.mask);
+        uint32_t leaf_hit = intersect_leaf(entry.index, entry.num_primitives,
+                                           packet, entry.mask);
+        if (leaf_hit) {
+          hit |= leaf_hit;
+          packet_rays.update_t_max();
+        }
+        continue;
+      }
+
+      if (std::popcount(entry.mask) < kMinPacketRays) {
+        // Too few rays left to share node tests: finish the subtree one ray
+        // at a time.
+        uint32_t subtree_hit = 0;
+        for_each_ray(entry.mask, [&](int i) {
+          uint32_t bit = 1u << i;
+          auto leaf = [&](int first, int count, Ray&) {
+            return intersect_leaf(first, count, packet, bit) != 0;
+          };
+          if (traverse_wide(packet.rays[i], leaf, entry.index)) {
+            subtree_hit |= bit;
+          }
+        });
+        if (subtree_hit) {
+          hit |= subtree_hit;
+          packet_rays.update_t_max();
+        }
+        continue;
+      }
+
+      ++record.nodes;
+      const WideBvhNode& node = wide_nodes_[entry.index];
+      int lanes = packet_rays.cull_wide(node, wide_motion(entry.index),
+                                        entry.mask, lane_masks, t_near);
+      // Far to near along the first ray, as in push_wide_children.
+      int order[kWideBvhWidth];
+      int num_lanes = 0;
+      for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+        if (!((lanes >> lane) & 1)) continue;
+        int i = num_lanes++;
+        while (i > 0 && t_near[order[i - 1]] < t_near[lane]) {
+          order[i] = order[i - 1];
+          --i;
+        }
+        order[i] = lane;
+      }
+      for (int i = 0; i < num_lanes; ++i) {
+        int lane = order[i];
+        stack[stack_size++] = {node.child[lane], node.num_primitives[lane],
+                               lane_masks[lane]};
+      }
+    }
+    return hit;
+  }
+
+  template <typename LeafFn>
+  uint32_t traverse_any_packet_wide(const RayPacket& packet, uint32_t mask,
+                                    LeafFn& occluded_leaf) const {
+    TraversalRecorder record;
+    PacketRays packet_rays(packet, mask);
+    PacketWideStackEntry stack[kWideStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = {0, 0, mask};
+    uint32_t occluded = 0;
+    uint32_t lane_masks[kWideBvhWidth];
+    float t_near[kWideBvhWidth];
+
+    while (stack_size > 0) {
+      const PacketWideStackEntry entry = stack[--stack_size];
+      uint32_t active = entry.mask & ~occluded;
+      if (active == 0) continue;
+      if (entry.num_primitives > 0) {
+        record.tests += entry.num_primitives * std::popcount(active);
+        occluded |= occluded_leaf(entry.index, entry.num_primitives, packet,
+                                  active);
+        if (occluded == mask) break;
+        continue;
+      }
+
+      if (std::popcount(active) < kMinPacketRays) {
+        for_each_ray(active, [&](int i) {
+          uint32_t bit = 1u << i;
+          auto leaf = [&](int first, int count, const Ray&) {
+            return occluded_leaf(first, count, packet, bit) != 0;
+          };
+          if (traverse_any_wide(packet.rays[i], leaf, entry.index)) {
+            occluded |= bit;
+          }
+        });
+        continue;
+      }
+
+      ++record.nodes;
+      const WideBvhNode& node = wide_nodes_[entry.index];
+      packet_rays.cull_wide(node, wide_motion(entry.index), active,
+                            lane_masks, t_near);
+      for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+        if (lane_masks[lane] == 0) continue;
+        stack[stack_size++] = {node.child[lane], node.num_primitives[lane],
+                               lane_masks[lane]};
+      }
+    }
+    return occluded;
+  }
+
+  // Builds the node arrays and returns the primitive infos in leaf order:
+  // leaves index contiguous ranges of it. Sets *references_split if spatial
+  // splits duplicated references, so the infos are no permutation of the
+  // objects.
+  std::vector<BvhPrimitiveInfo> build_nodes(const std::vector<T>& objects,
+                                            const BvhBuildConfig& config,
+                                            bool* references_split = nullptr) {
+    nodes_.clear();
+    wide_nodes_.clear();
+    if (objects.empty()) return {};
+
+    const int num_objects = static_cast<int>(objects.size());
+    const bool nested = omp_in_parallel();
+    std::vector<BvhPrimitiveInfo> infos(num_objects);
+#pragma omp parallel for if (!nested && num_objects > kParallelBuildThreshold)
+    for (int i = 0; i < num_objects; ++i) {
+      infos[i].bounds = objects[i].get_aabb();
+      infos[i].centroid = infos[i].bounds.centroid();
+      infos[i].index = i;
+    }
+
+    // When already running inside a parallel region (e.g. several meshes
+    // being built at once) the subtree tasks join that team instead of
+    // opening a nested one.
+    BvhNodeArena arena(nested ? omp_get_num_threads() : omp_get_max_threads());
+    BvhBuildNode* root = nullptr;
+    if constexpr (SpatiallySplittable<T>) {
+      if (config.split_method == BvhSplitMethod::SBVH) {
+        SbvhBuildState state;
+        AABB root_bounds, root_centroids;
+        compute_bounds(infos, 0, num_objects, root_bounds, root_centroids);
+        state.min_overlap_area =
+            kSpatialSplitAlpha * root_bounds.surface_area();
+        state.num_references = num_objects;
+        state.max_references = static_cast<int>(
+            num_objects * (1.0f + std::max(config.spatial_split_budget, 0.0f)));
+        if (nested) {
+          root = spatial_recursive_build(objects, std::move(infos), config,
+                                         arena, state);
+        } else {
+#pragma omp parallel
+#pragma omp single
+          root = spatial_recursive_build(objects, std::move(infos), config,
+                                         arena, state);
+        }
+        infos = std::move(state.leaf_references);
+        if (references_split) *references_split = state.references_split.load();
+      }
+    }
+    if (!root) {
+      if (nested) {
+        root = recursive_build(infos, 0, num_objects, config, arena);
+      } else {
+#pragma omp parallel
+#pragma omp single
+        root = recursive_build(infos, 0, num_objects, config, arena);
+      }
+    }
+
+    // The arena knows the exact node count, so the linear nodes are written
+    // once into storage of the final size.
+    nodes_.resize(arena.size());
+    int offset = 0;
+    flatten_bvh_tree(root, &offset);
+    config_ = config;
+    sah_cost_ = compute_sah_cost(config);
+
+    motion_end_bounds_.clear();
+    if constexpr (requires(const T& t) { t.get_aabb_at(0.0f); }) {
+      bool any_motion = false;
+      for (const T& object : objects) any_motion |= object.has_motion();
+      if (any_motion) {
+        compute_motion_bounds([&](int i) -> const T& {
+          return objects[infos[i].index];
+        });
+      }
+    }
+
+    build_wide_nodes(config.layout);
+    return infos;
+  }
+
+  // Collapses nodes_ (and motion_end_bounds_) into the 4-wide layout.
+  void build_wide_nodes(BvhLayout layout) {
+    wide_nodes_.clear();
+    wide_motion_.clear();
+    if (layout == BvhLayout::Wide4) {
+      wide_nodes_.reserve(nodes_.size() / 2 + 1);
+      std::vector<int> lane_sources;
+      collapse_to_wide(nodes_, 0, wide_nodes_,
+                       motion_end_bounds_.empty() ? nullptr : &lane_sources);
+      if (!motion_end_bounds_.empty()) {
+        wide_motion_.resize(wide_nodes_.size());
+        for (size_t i = 0; i < wide_nodes_.size(); ++i) {
+          for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+            int source = lane_sources[i * kWideBvhWidth + lane];
+            const AABB& b = source >= 0 ? motion_end_bounds_[source] : AABB();
+            for (int a = 0; a < 3; ++a) {
+              wide_motion_[i].bounds[2 * a][lane] = b[a].min;
+              wide_motion_[i].bounds[2 * a + 1][lane] = b[a].max;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // For primitives that move during the shutter interval, replaces every
+  // node box by its bounds at time 0 and stores the bounds at time 1 in
+  // motion_end_bounds_. Traversal interpolates between the two by
+  // ray.time, so a fast moving object no longer gets one box spanning its
+  // whole path. Requires bounds that move linearly in time.
+  // `object_at(i)` returns the primitive at leaf position i.
+  template <typename ObjectFn>
+  void compute_motion_bounds(ObjectFn&& object_at) {
+    motion_end_bounds_.resize(nodes_.size());
+    // Children always follow their parent in the flattened order.
+    for (int i = static_cast<int>(nodes_.size()) - 1; i >= 0; --i) {
+      LinearBvhNode& node = nodes_[i];
+      AABB start, end;
+      if (node.num_primitives > 0) {
+        for (int k = 0; k < node.num_primitives; ++k) {
+          const T& object = object_at(node.primitives_offset + k);
+          start.expand(object.get_aabb_at(0.0f));
+          end.expand(object.get_aabb_at(1.0f));
+        }
+      } else {
+        start = nodes_[i + 1].bbox;
+        start.expand(nodes_[node.second_child_offset].bbox);
+        end = motion_end_bounds_[i + 1];
+        end.expand(motion_end_bounds_[node.second_child_offset]);
+      }
+      node.bbox = start;
+      motion_end_bounds_[i] = end;
+    }
+  }
+
+  bool node_intersects(int index, const Ray& ray) const {
+    if (motion_end_bounds_.empty()) return nodes_[index].bbox.intersect(ray);
+    return nodes_[index].bbox.lerp(motion_end_bounds_[index], ray.time)
+        .intersect(ray);
+  }
+
+  const AABB* motion_end_bound(int index) const {
+    return motion_end_bounds_.empty() ? nullptr : &motion_end_bounds_[index];
+  }
+
+  const WideMotionBounds* wide_motion(int index) const {
+    return wide_motion_.empty() ? nullptr : &wide_motion_[index];
+  }
+
+  float compute_sah_cost(const BvhBuildConfig& config) const {
+    float root_area = nodes_[0].bbox.surface_area();
+    if (root_area <= 0.0f) return 0.0f;
+
+    float cost = 0.0f;
+    for (const LinearBvhNode& node : nodes_) {
+      float p = node.bbox.surface_area() / root_area;
+      cost += node.num_primitives > 0
+                  ? p * config.intersection_cost * node.num_primitives
+                  : p * config.traversal_cost;
+    }
+    return cost;
+  }
 
-  int flatten_bvh_tree(BvhBuildNode* node, int* offset) {
+  int flatten_bvh_tree(const BvhBuildNode* node, int* offset) {
     LinearBvhNode* linear_node = &nodes_[*offset];
     linear_node->bbox = node->bounds;
     int my_offset = (*offset)++;
@@ -206,7 +1537,6 @@ class BVH {
       flatten_bvh_tree(node->left, offset);
       linear_node->second_child_offset = flatten_bvh_tree(node->right, offset);
     }
-    delete node;
 
     return my_offset;
   }
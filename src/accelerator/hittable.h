@@ -4,6 +4,7 @@
 #include "core/hit_record.h"
 #include "core/interval.h"
 #include "core/ray.h"
+#include "core/ray_packet.h"
 #include "core/types.h"
 
 namespace hasmet{
@@ -16,7 +17,34 @@ struct SurfaceSample {
 class Hittable {
  public:
   virtual ~Hittable() = default;
+  // Only records what is needed to pick the closest hit. finalize_hit then
+  // fills in the shading data for that hit, given the same ray.
   virtual bool intersect(Ray& ray, HitRecord& rec) const = 0;
+  virtual void finalize_hit(const Ray& ray, HitRecord& rec) const {}
+  // Any hit within [ray.t_min, ray.t_max]; used by shadow rays.
+  virtual bool occluded(const Ray& ray) const = 0;
+  // Packet versions for the rays in `mask`, returning the rays that hit,
+  // with recs indexed like the rays. Unlike intersect, intersect_packet
+  // shrinks t_max of the rays it hits. By default the rays go one at a
+  // time.
+  virtual uint32_t intersect_packet(RayPacket& packet, uint32_t mask,
+                                    HitRecord* recs) const {
+    uint32_t hit = 0;
+    for_each_ray(mask, [&](int i) {
+      if (!intersect(packet.rays[i], recs[i])) return;
+      packet.rays[i].t_max = recs[i].t;
+      hit |= 1u << i;
+    });
+    return hit;
+  }
+  virtual uint32_t occluded_packet(const RayPacket& packet,
+                                   uint32_t mask) const {
+    uint32_t occluded_rays = 0;
+    for_each_ray(mask, [&](int i) {
+      if (occluded(packet.rays[i])) occluded_rays |= 1u << i;
+    });
+    return occluded_rays;
+  }
   virtual AABB get_aabb() const = 0;
   virtual SurfaceSample sample_surface(const Vec2& u) const { return {}; }
   virtual float get_area() const { return 0.0f; }
@@ -5,32 +5,49 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include "core/affine.h"
 #include "core/sampler.h"
 
 namespace hasmet {
 class Instance : public Hittable {
  public:
-  Instance(std::shared_ptr<Hittable> object) : object_(object), material_id_(1) {}
-
-  // TODO: Solve temporal coupling between set_transform and set_motion_blur
+  Instance(std::shared_ptr<Hittable> object)
+      : object_(object),
+        world_aabb_(object->get_aabb()),
+        start_aabb_(world_aabb_),
+        world_area_(object->get_area()),
+        material_id_(1) {}
+
+  // Everything derived from the transform is computed here once rather than
+  // per ray or per light sample. Can be called again, e.g. per animation
+  // frame, and keeps any motion blur already set.
   void set_transform(const glm::mat4& m) {
-    transform_ = m;
-    inv_transform_ = glm::inverse(m);
-    world_aabb_ = object_->get_aabb();
-    world_aabb_.apply_transformation(transform_);
+    transform_ = AffineTransform(m);
+    inv_transform_ = AffineTransform(glm::inverse(m));
+    normal_matrix_ = glm::transpose(inv_transform_.linear);
+    refresh_bounds();
   }
 
   void set_motion_blur(const Vec3& v) {
     if (glm::dot(v, v) > 1e-8f) {
       motion_blur_ = v;
       has_motion_blur_ = true;
-
-      AABB end_aabb = world_aabb_;
-      glm::mat4 motion_blur_m = glm::translate(glm::mat4(1.0f), v);
-      end_aabb.apply_transformation(motion_blur_m);
-      world_aabb_.expand(end_aabb);
+      world_aabb_ = start_aabb_;
+      expand_for_motion();
     }
   }
+
+  // Recomputes the world bounds and area after the object itself changed,
+  // e.g. a mesh whose vertices were deformed.
+  void refresh_bounds() {
+    float area_scale = glm::length(glm::cross(transform_.linear[0],
+                                              transform_.linear[1]));
+    world_area_ = object_->get_area() * area_scale;
+    world_aabb_ = object_->get_aabb();
+    world_aabb_.apply_transformation(transform_.to_mat4());
+    start_aabb_ = world_aabb_;
+    if (has_motion_blur_) expand_for_motion();
+  }
   
   void set_material_id(int material_id) {
     material_id_ = material_id;
@@ -41,14 +58,48 @@ class Instance : public Hittable {
   }
   
   virtual bool intersect(Ray& ray, HitRecord& rec) const override {
-    Ray local_ray = ray;
-    if (has_motion_blur_) local_ray.origin -= motion_blur_ * ray.time;
-    
-    local_ray.origin = Vec3(inv_transform_ * glm::vec4(local_ray.origin, 1.0f));
-    local_ray.direction = Vec3(inv_transform_ * glm::vec4(local_ray.direction, 0.0f));
-
+    Ray local_ray = to_local(ray);
     if (!object_->intersect(local_ray, rec)) return false;
 
+    rec.instance = this;
+    ray.t_max = local_ray.t_max;
+    return true;
+  }
+
+  bool occluded(const Ray& ray) const override {
+    return object_->occluded(to_local(ray));
+  }
+
+  uint32_t intersect_packet(RayPacket& packet, uint32_t mask,
+                            HitRecord* recs) const override {
+    RayPacket local_packet;
+    local_packet.size = packet.size;
+    for_each_ray(mask, [&](int i) {
+      local_packet.rays[i] = to_local(packet.rays[i]);
+    });
+    uint32_t hit = object_->intersect_packet(local_packet, mask, recs);
+    for_each_ray(hit, [&](int i) {
+      recs[i].instance = this;
+      packet.rays[i].t_max = local_packet.rays[i].t_max;
+    });
+    return hit;
+  }
+
+  uint32_t occluded_packet(const RayPacket& packet,
+                           uint32_t mask) const override {
+    RayPacket local_packet;
+    local_packet.size = packet.size;
+    for_each_ray(mask, [&](int i) {
+      local_packet.rays[i] = to_local(packet.rays[i]);
+    });
+    return object_->occluded_packet(local_packet, mask);
+  }
+
+  // The local ray is rebuilt rather than kept from intersect; it is cheap
+  // and only done once per traced ray.
+  void finalize_hit(const Ray& ray, HitRecord& rec) const override {
+    object_->finalize_hit(to_local(ray), rec);
+
     rec.p = ray.at(rec.t);
     rec.material_id = material_id_;
     rec.texture_ids = &this->texture_ids_;
@@ -57,29 +108,38 @@ class Instance : public Hittable {
     }
     if (has_motion_blur_) rec.p += motion_blur_ * ray.time;
     
-    glm::mat normal_matrix = glm::transpose(glm::mat3(inv_transform_));
-    rec.normal = glm::normalize(normal_matrix * rec.normal);
+    rec.normal = glm::normalize(normal_matrix_ * rec.normal);
     
     // glm::mat3 model_rot_scale = glm::mat3(glm::inverse(transform_));
     // if(rec.tangents){
     //   rec.tangents[0] = glm::normalize(model_rot_scale * rec.tangents[0]);
     //   rec.tangents[1] = glm::normalize(model_rot_scale * rec.tangents[1]);
     // }
-
-    ray.t_max = local_ray.t_max;
-    return true;
   }
 
+  // Union over the whole shutter interval.
   virtual AABB get_aabb() const override { return world_aabb_; }
 
+  bool has_motion() const { return has_motion_blur_; }
+
+  // Bounds at a shutter time in [0, 1]. Translation blur moves them
+  // linearly, which is what the motion BVH interpolates.
+  AABB get_aabb_at(float time) const {
+    if (!has_motion_blur_) return world_aabb_;
+    return start_aabb_.translated(motion_blur_ * time);
+  }
+
+  const Hittable& object() const { return *object_; }
+  const AffineTransform& transform() const { return transform_; }
+  const Mat3& normal_matrix() const { return normal_matrix_; }
+
   bool is_light() const { return glm::length(radiance_) > 0; }
 
   LightSample sample_li(const HitRecord& rec, const Vec2& u) const {
     SurfaceSample ss = object_->sample_surface(u);
     // Transform sampled point and normal to world space
-    Vec3 world_p = Vec3(transform_ * glm::vec4(ss.p, 1.0f));
-    glm::mat3 normal_matrix = glm::transpose(glm::mat3(inv_transform_));
-    Vec3 world_n = glm::normalize(normal_matrix * ss.n);
+    Vec3 world_p = transform_.apply_point(ss.p);
+    Vec3 world_n = glm::normalize(normal_matrix_ * ss.n);
 
     Vec3 wi_full = world_p - rec.p;
     float dist2 = glm::dot(wi_full, wi_full);
@@ -90,11 +150,7 @@ class Instance : public Hittable {
     if (cos_light < 1e-8f) return {};
 
     // Convert area PDF to solid-angle PDF: pdf_area * dist^2 / cos_light
-    // Account for transform scaling on area
-    float scale_factor = glm::length(glm::cross(
-        Vec3(transform_[0]), Vec3(transform_[1])));
-    float world_area = object_->get_area() * scale_factor;
-    float pdf_area = 1.0f / world_area;
+    float pdf_area = 1.0f / world_area_;
     float pdf_solid = pdf_area * dist2 / cos_light;
 
     Color L = radiance_ * cos_light / dist2;
@@ -107,30 +163,46 @@ class Instance : public Hittable {
     HitRecord test_rec;
 
     Ray local_ray = test_ray;
-    local_ray.origin = Vec3(inv_transform_ * glm::vec4(local_ray.origin, 1.0f));
-    local_ray.direction = Vec3(inv_transform_ * glm::vec4(local_ray.direction, 0.0f));
+    local_ray.origin = inv_transform_.apply_point(local_ray.origin);
+    local_ray.set_direction(inv_transform_.apply_vector(local_ray.direction));
 
     if (!object_->intersect(local_ray, test_rec)) return 0.0f;
+    object_->finalize_hit(local_ray, test_rec);
 
     float dist2 = test_rec.t * test_rec.t;
-    glm::mat3 normal_matrix = glm::transpose(glm::mat3(inv_transform_));
-    Vec3 world_n = glm::normalize(normal_matrix * test_rec.normal);
+    Vec3 world_n = glm::normalize(normal_matrix_ * test_rec.normal);
     float cos_light = std::abs(glm::dot(world_n, -wi));
     if (cos_light < 1e-8f) return 0.0f;
 
-    float scale_factor = glm::length(glm::cross(
-        Vec3(transform_[0]), Vec3(transform_[1])));
-    float world_area = object_->get_area() * scale_factor;
-    float pdf_area = 1.0f / world_area;
+    float pdf_area = 1.0f / world_area_;
     return pdf_area * dist2 / cos_light;
   }
 
   Color radiance_{0.0f};
  private:
+  void expand_for_motion() {
+    AABB end_aabb = start_aabb_;
+    glm::mat4 motion_blur_m = glm::translate(glm::mat4(1.0f), motion_blur_);
+    end_aabb.apply_transformation(motion_blur_m);
+    world_aabb_.expand(end_aabb);
+  }
+
+  Ray to_local(const Ray& ray) const {
+    Ray local_ray = ray;
+    if (has_motion_blur_) local_ray.origin -= motion_blur_ * ray.time;
+
+    local_ray.origin = inv_transform_.apply_point(local_ray.origin);
+    local_ray.set_direction(inv_transform_.apply_vector(local_ray.direction));
+    return local_ray;
+  }
+
   std::shared_ptr<Hittable> object_;
-  glm::mat4 transform_{1.0f};
-  glm::mat4 inv_transform_{1.0f};
+  AffineTransform transform_;
+  AffineTransform inv_transform_;
+  Mat3 normal_matrix_{1.0f};
   AABB world_aabb_;
+  AABB start_aabb_;
+  float world_area_ = 0.0f;
   Vec3 motion_blur_{0.0f};
   bool has_motion_blur_ = false;
   int material_id_;
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+
+#include "core/aabb.h"
+#include "core/ray.h"
+#include "core/ray_packet.h"
+#include "core/simd.h"
+#include "wide_bvh.h"
+
+namespace hasmet {
+
+// Box of one lane of a wide node's (or its motion end's) bounds rows.
+inline AABB wide_lane_bounds(const float bounds[6][kWideBvhWidth], int lane) {
+  AABB box;
+  box.x = Interval(bounds[0][lane], bounds[1][lane]);
+  box.y = Interval(bounds[2][lane], bounds[3][lane]);
+  box.z = Interval(bounds[4][lane], bounds[5][lane]);
+  return box;
+}
+
+// Node test data of a coherent packet (see RayPacket::is_coherent): the
+// rays in SoA form for testing one box against all of them, and interval
+// bounds over the rays for rejecting a box for the whole packet at once.
+// Lanes outside the mask repeat the first ray and are masked off by the
+// tests. Boxes of motion BVHs come with their bounds at shutter time 1,
+// `end`, and are interpolated to each ray's time. Masks passed in must not
+// be empty.
+class PacketRays {
+ public:
+  PacketRays(const RayPacket& packet, uint32_t mask)
+      : packet_(packet), mask_(mask) {
+    const Ray& first = packet.first(mask);
+    for (int a = 0; a < 3; ++a) {
+      sign_[a] = first.sign[a];
+      origin_min_[a] = origin_max_[a] = first.origin[a];
+      inv_dir_min_[a] = inv_dir_max_[a] = first.inv_direction[a];
+    }
+    t_min_ = first.t_min;
+    for_each_ray(mask, [&](int i) {
+      const Ray& ray = packet.rays[i];
+      for (int a = 0; a < 3; ++a) {
+        origin_min_[a] = std::min(origin_min_[a], ray.origin[a]);
+        origin_max_[a] = std::max(origin_max_[a], ray.origin[a]);
+        inv_dir_min_[a] = std::min(inv_dir_min_[a], ray.inv_direction[a]);
+        inv_dir_max_[a] = std::max(inv_dir_max_[a], ray.inv_direction[a]);
+      }
+      t_min_ = std::min(t_min_, ray.t_min);
+    });
+#ifdef HASMET_USE_SSE
+    for (int v = 0; v < kVectors; ++v) {
+      alignas(16) float o[3][4], inv[3][4], t0[4];
+      alignas(16) float time[4];
+      for (int lane = 0; lane < 4; ++lane) {
+        int i = 4 * v + lane;
+        const Ray& ray = (mask >> i) & 1 ? packet.rays[i] : first;
+        for (int a = 0; a < 3; ++a) {
+          o[a][lane] = ray.origin[a];
+          inv[a][lane] = ray.inv_direction[a];
+        }
+        t0[lane] = ray.t_min;
+        time[lane] = ray.time;
+      }
+      for (int a = 0; a < 3; ++a) {
+        origin_[a][v] = _mm_load_ps(o[a]);
+        inv_dir_[a][v] = _mm_load_ps(inv[a]);
+      }
+      t_min_v_[v] = _mm_load_ps(t0);
+      time_v_[v] = _mm_load_ps(time);
+    }
+#endif
+    update_t_max();
+  }
+
+  // Re-reads t_max from the rays once a leaf has shortened some of them.
+  void update_t_max() {
+    const Ray& first = packet_.first(mask_);
+    t_max_ = first.t_max;
+    for_each_ray(mask_, [&](int i) {
+      t_max_ = std::max(t_max_, packet_.rays[i].t_max);
+    });
+#ifdef HASMET_USE_SSE
+    for (int v = 0; v < kVectors; ++v) {
+      alignas(16) float t1[4];
+      for (int lane = 0; lane < 4; ++lane) {
+        int i = 4 * v + lane;
+        t1[lane] = (mask_ >> i) & 1 ? packet_.rays[i].t_max : first.t_max;
+      }
+      t_max_v_[v] = _mm_load_ps(t1);
+    }
+#endif
+  }
+
+  // Interval arithmetic test: true if no ray of the packet can hit `box`
+  // within its [t_min, t_max]. Moving boxes are tested as the union over
+  // the shutter interval.
+  bool misses(const AABB& box, const AABB* end) const {
+    if (end) {
+      AABB swept = box;
+      swept.expand(*end);
+      return misses(swept, nullptr);
+    }
+    float t_enter = t_min_;
+    float t_exit = t_max_;
+    for (int a = 0; a < 3; ++a) {
+      const Interval& slab = box.axis(a);
+      float near_bound = sign_[a] ? slab.max : slab.min;
+      float far_bound = sign_[a] ? slab.min : slab.max;
+      t_enter = std::max(t_enter,
+                         interval_product_min(near_bound - origin_max_[a],
+                                              near_bound - origin_min_[a],
+                                              a));
+      t_exit = std::min(t_exit,
+                        interval_product_max(far_bound - origin_max_[a],
+                                             far_bound - origin_min_[a], a));
+    }
+    return t_enter >= t_exit;
+  }
+
+  // Exact slab test of every ray in `mask`; returns the rays that hit.
+  uint32_t intersect(const AABB& box, const AABB* end, uint32_t mask) const {
+#ifdef HASMET_USE_SSE
+    uint32_t hit = 0;
+    for (int v = 0; v < kVectors; ++v) {
+      __m128 t_enter = t_min_v_[v];
+      __m128 t_exit = t_max_v_[v];
+      for (int a = 0; a < 3; ++a) {
+        const Interval& slab = box.axis(a);
+        __m128 near_bound = _mm_set1_ps(sign_[a] ? slab.max : slab.min);
+        __m128 far_bound = _mm_set1_ps(sign_[a] ? slab.min : slab.max);
+        if (end) {
+          const Interval& end_slab = end->axis(a);
+          __m128 near_end = _mm_set1_ps(sign_[a] ? end_slab.max : end_slab.min);
+          __m128 far_end = _mm_set1_ps(sign_[a] ? end_slab.min : end_slab.max);
+          near_bound = _mm_add_ps(
+              near_bound,
+              _mm_mul_ps(time_v_[v], _mm_sub_ps(near_end, near_bound)));
+          far_bound = _mm_add_ps(
+              far_bound,
+              _mm_mul_ps(time_v_[v], _mm_sub_ps(far_end, far_bound)));
+        }
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(near_bound, origin_[a][v]),
+                               inv_dir_[a][v]);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(far_bound, origin_[a][v]),
+                               inv_dir_[a][v]);
+        t_enter = _mm_max_ps(t0, t_enter);
+        t_exit = _mm_min_ps(t1, t_exit);
+      }
+      hit |= static_cast<uint32_t>(
+                 _mm_movemask_ps(_mm_cmplt_ps(t_enter, t_exit)))
+             << (4 * v);
+    }
+    return hit & mask;
+#else
+    uint32_t hit = 0;
+    for_each_ray(mask, [&](int i) {
+      const Ray& ray = packet_.rays[i];
+      if ((end ? box.lerp(*end, ray.time) : box).intersect(ray)) {
+        hit |= 1u << i;
+      }
+    });
+    return hit;
+#endif
+  }
+
+  // Rays of `mask` that may hit `box`. A hit of the first ray lets the
+  // whole mask in without testing the others, which is the common case for
+  // coherent rays; only then is the box rejected for the packet or tested
+  // per ray.
+  uint32_t cull(const AABB& box, const AABB* end, uint32_t mask) const {
+    assert(mask != 0);
+    if (mask == 0) return 0;
+    const Ray& first = packet_.first(mask);
+    if ((end ? box.lerp(*end, first.time) : box).intersect(first)) return mask;
+    if (misses(box, end)) return 0;
+    return intersect(box, end, mask);
+  }
+
+  // cull() for the lanes of a wide node: one SSE test of the first ray
+  // against all lanes, then the other tests only for lanes it misses.
+  // Leaf lanes always get the exact ray set. Writes the rays of each lane
+  // to lane_masks and the first ray's entry distances, for ordering, to
+  // t_near; returns the mask of lanes with any ray.
+  int cull_wide(const WideBvhNode& node, const WideMotionBounds* motion,
+                uint32_t mask, uint32_t lane_masks[kWideBvhWidth],
+                float t_near[kWideBvhWidth]) const {
+    assert(mask != 0);
+    if (mask == 0) {
+      std::fill(lane_masks, lane_masks + kWideBvhWidth, 0u);
+      return 0;
+    }
+    WideRay first(packet_.first(mask));
+    int first_hits = intersect_wide_node(node, motion, first, t_near);
+    int lanes = 0;
+    for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+      lane_masks[lane] = 0;
+      if (node.is_empty(lane)) continue;
+      bool first_hit = (first_hits >> lane) & 1;
+      if (first_hit && !node.is_leaf(lane)) {
+        lane_masks[lane] = mask;
+      } else {
+        AABB box = wide_lane_bounds(node.bounds, lane);
+        AABB end_box;
+        if (motion) end_box = wide_lane_bounds(motion->bounds, lane);
+        const AABB* end = motion ? &end_box : nullptr;
+        if (!first_hit && misses(box, end)) continue;
+        lane_masks[lane] = intersect(box, end, mask);
+      }
+      if (lane_masks[lane]) lanes |= 1 << lane;
+    }
+    return lanes;
+  }
+
+ private:
+  static constexpr int kVectors = kRayPacketSize / 4;
+
+  // Bounds of {x * inv_dir | x in [lo, hi]} over the packet's reciprocal
+  // directions on `axis`.
+  float interval_product_min(float lo, float hi, int axis) const {
+    return std::min(std::min(lo * inv_dir_min_[axis], lo * inv_dir_max_[axis]),
+                    std::min(hi * inv_dir_min_[axis], hi * inv_dir_max_[axis]));
+  }
+  float interval_product_max(float lo, float hi, int axis) const {
+    return std::max(std::max(lo * inv_dir_min_[axis], lo * inv_dir_max_[axis]),
+                    std::max(hi * inv_dir_min_[axis], hi * inv_dir_max_[axis]));
+  }
+
+  const RayPacket& packet_;
+  uint32_t mask_;
+  int sign_[3];
+  float origin_min_[3], origin_max_[3];
+  float inv_dir_min_[3], inv_dir_max_[3];
+  float t_min_, t_max_;
+#ifdef HASMET_USE_SSE
+  __m128 origin_[3][kVectors];
+  __m128 inv_dir_[3][kVectors];
+  __m128 t_min_v_[kVectors];
+  __m128 t_max_v_[kVectors];
+  __m128 time_v_[kVectors];
+#endif
+};
+}  // namespace hasmet
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "core/aabb.h"
+#include "core/ray.h"
+#include "core/simd.h"
+
+namespace hasmet {
+
+enum class BvhLayout { Binary, Wide4 };
+
+constexpr int kWideBvhWidth = 4;
+
+// Four children with their bounds stored per axis, so one SSE instruction
+// stream tests all of them against a ray. Unused lanes have child -1 and are
+// skipped by the traversal.
+struct alignas(16) WideBvhNode {
+  // Row 2 * axis holds the lane minima of that axis, row 2 * axis + 1 the
+  // maxima.
+  float bounds[6][kWideBvhWidth];
+  // Leaf lanes: primitive offset. Interior lanes: wide node index.
+  int32_t child[kWideBvhWidth];
+  // Zero for interior and empty lanes.
+  uint16_t num_primitives[kWideBvhWidth];
+
+  void set_child(int lane, const AABB& b, int index, int n) {
+    for (int a = 0; a < 3; ++a) {
+      bounds[2 * a][lane] = b[a].min;
+      bounds[2 * a + 1][lane] = b[a].max;
+    }
+    child[lane] = index;
+    num_primitives[lane] = static_cast<uint16_t>(n);
+  }
+
+  void clear_child(int lane) {
+    set_child(lane, AABB(), -1, 0);
+  }
+
+  bool is_empty(int lane) const { return child[lane] < 0; }
+  bool is_leaf(int lane) const { return num_primitives[lane] > 0; }
+};
+
+// Lane bounds at shutter time 1 for motion BVHs, parallel to the wide
+// nodes, whose own bounds then hold time 0.
+struct alignas(16) WideMotionBounds {
+  float bounds[6][kWideBvhWidth];
+};
+
+// Collapses the binary tree rooted at `index` into wide nodes by repeatedly
+// opening the interior child with the largest surface area. Returns the
+// index of the created wide node. If `lane_sources` is given it receives,
+// per wide node, the binary node each lane was copied from (-1 if empty).
+template <typename LinearNode>
+int collapse_to_wide(const std::vector<LinearNode>& nodes, int index,
+                     std::vector<WideBvhNode>& out,
+                     std::vector<int>* lane_sources = nullptr) {
+  int children[kWideBvhWidth];
+  int num_children = 0;
+  const LinearNode& root = nodes[index];
+  if (root.num_primitives > 0) {
+    children[num_children++] = index;
+  } else {
+    children[num_children++] = index + 1;
+    children[num_children++] = root.second_child_offset;
+  }
+
+  while (num_children < kWideBvhWidth) {
+    int best = -1;
+    float best_area = -1.0f;
+    for (int i = 0; i < num_children; ++i) {
+      const LinearNode& c = nodes[children[i]];
+      if (c.num_primitives > 0) continue;
+      float area = c.bbox.surface_area();
+      if (area > best_area) {
+        best = i;
+        best_area = area;
+      }
+    }
+    if (best < 0) break;
+
+    int opened = children[best];
+    children[best] = opened + 1;
+    children[num_children++] = nodes[opened].second_child_offset;
+  }
+
+  int wide_index = static_cast<int>(out.size());
+  out.emplace_back();
+  if (lane_sources) {
+    for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+      lane_sources->push_back(lane < num_children ? children[lane] : -1);
+    }
+  }
+  for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+    if (lane >= num_children) {
+      out[wide_index].clear_child(lane);
+      continue;
+    }
+    const LinearNode& c = nodes[children[lane]];
+    if (c.num_primitives > 0) {
+      out[wide_index].set_child(lane, c.bbox, c.primitives_offset,
+                                c.num_primitives);
+    } else {
+      int child_index =
+          collapse_to_wide(nodes, children[lane], out, lane_sources);
+      out[wide_index].set_child(lane, c.bbox, child_index, 0);
+    }
+  }
+  return wide_index;
+}
+
+// Ray data shared by every node test of one traversal. The near and far rows
+// follow from the ray's sign bits, so the slab test needs no min/max per
+// axis.
+struct WideRay {
+#ifdef HASMET_USE_SSE
+  __m128 origin[3];
+  __m128 inv_dir[3];
+#endif
+  const Ray& ray;
+  int near_row[3];
+  int far_row[3];
+
+  explicit WideRay(const Ray& r) : ray(r) {
+    for (int a = 0; a < 3; ++a) {
+      near_row[a] = 2 * a + ray.sign[a];
+      far_row[a] = 2 * a + 1 - ray.sign[a];
+#ifdef HASMET_USE_SSE
+      origin[a] = _mm_set1_ps(ray.origin[a]);
+      inv_dir[a] = _mm_set1_ps(ray.inv_direction[a]);
+#endif
+    }
+  }
+};
+
+// Slab test of all lanes against [ray.t_min, ray.t_max]. Writes the entry
+// distance of each lane and returns a bit mask of the lanes that are hit.
+// With `motion` the lane bounds are interpolated to ray.time first.
+inline int intersect_wide_node(const WideBvhNode& node,
+                               const WideMotionBounds* motion,
+                               const WideRay& wray,
+                               float t_near[kWideBvhWidth]) {
+#ifdef HASMET_USE_SSE
+  __m128 t_enter = _mm_set1_ps(wray.ray.t_min);
+  __m128 t_exit = _mm_set1_ps(wray.ray.t_max);
+  __m128 time = _mm_set1_ps(wray.ray.time);
+  for (int a = 0; a < 3; ++a) {
+    __m128 near_bound = _mm_load_ps(node.bounds[wray.near_row[a]]);
+    __m128 far_bound = _mm_load_ps(node.bounds[wray.far_row[a]]);
+    if (motion) {
+      __m128 near_end = _mm_load_ps(motion->bounds[wray.near_row[a]]);
+      __m128 far_end = _mm_load_ps(motion->bounds[wray.far_row[a]]);
+      near_bound = _mm_add_ps(
+          near_bound, _mm_mul_ps(time, _mm_sub_ps(near_end, near_bound)));
+      far_bound = _mm_add_ps(
+          far_bound, _mm_mul_ps(time, _mm_sub_ps(far_end, far_bound)));
+    }
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(near_bound, wray.origin[a]),
+                           wray.inv_dir[a]);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(far_bound, wray.origin[a]),
+                           wray.inv_dir[a]);
+    // _mm_max_ps and _mm_min_ps return their second operand when either
+    // is NaN, which keeps the NaN of a parallel axis (see
+    // AABB::intersect) out of the running bounds.
+    t_enter = _mm_max_ps(t0, t_enter);
+    t_exit = _mm_min_ps(t1, t_exit);
+  }
+  _mm_storeu_ps(t_near, t_enter);
+  return _mm_movemask_ps(_mm_cmplt_ps(t_enter, t_exit));
+#else
+  const Ray& ray = wray.ray;
+  int mask = 0;
+  for (int lane = 0; lane < kWideBvhWidth; ++lane) {
+    float t_enter = ray.t_min;
+    float t_exit = ray.t_max;
+    for (int a = 0; a < 3; ++a) {
+      float near_bound = node.bounds[wray.near_row[a]][lane];
+      float far_bound = node.bounds[wray.far_row[a]][lane];
+      if (motion) {
+        near_bound += ray.time *
+                      (motion->bounds[wray.near_row[a]][lane] - near_bound);
+        far_bound += ray.time *
+                     (motion->bounds[wray.far_row[a]][lane] - far_bound);
+      }
+      float t0 = (near_bound - ray.origin[a]) * ray.inv_direction[a];
+      float t1 = (far_bound - ray.origin[a]) * ray.inv_direction[a];
+      // NaN slab terms go second, as in AABB::intersect.
+      t_enter = std::max(t_enter, t0);
+      t_exit = std::min(t_exit, t1);
+    }
+    t_near[lane] = t_enter;
+    if (t_enter < t_exit) mask |= 1 << lane;
+  }
+  return mask;
+#endif
+}
+
+}  // namespace hasmet
@@ -61,7 +61,9 @@ Ray PinholeCamera::generateRay(float px, float py, glm::vec2 u_pixel,
                         (py + u_pixel.y) * vertical_spacing_;
   Vec3 direction = glm::normalize(point_on_plane - position_);
 
-  return Ray(position_, direction);
+  Ray ray(position_, direction);
+  ray.type = RayType::Camera;
+  return ray;
 }
 
 void PinholeCamera::generate_pixel_samples(int px, int py,
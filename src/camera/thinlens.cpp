@@ -69,7 +69,9 @@ Ray ThinLensCamera::generateRay(float px, float py, glm::vec2 u_pixel,
   float t_fp = focus_distance_ / glm::dot(dir_to_target, -w_);
   Vec3 p = position_ + t_fp * dir_to_target;
 
-  return Ray(a, glm::normalize(p - a));
+  Ray ray(a, glm::normalize(p - a));
+  ray.type = RayType::Camera;
+  return ray;
 }
 
 void ThinLensCamera::generate_pixel_samples(int px, int py,
@@ -61,32 +61,30 @@ class AABB {
     z = Interval(new_min.z, new_max.z);
   }
 
+  // Tests against [ray.t_min, ray.t_max], so boxes behind the closest hit
+  // found so far are rejected. The ray's sign bits select the near and far
+  // slab of each axis, which leaves no branches or per-axis min/max.
   bool intersect(const Ray& ray) const {
-    Vec3 inv_dir = 1.0f / ray.direction;
-    float t_min = ray.t_min;
-    float t_max = ray.t_max;
-
-    float tx1 = (x.min - ray.origin.x) * inv_dir.x;
-    float tx2 = (x.max - ray.origin.x) * inv_dir.x;
-
-    t_min = std::max(t_min, std::min(tx1, tx2));
-    t_max = std::min(t_max, std::max(tx1, tx2));
-
-    float ty1 = (y.min - ray.origin.y) * inv_dir.y;
-    float ty2 = (y.max - ray.origin.y) * inv_dir.y;
-
-    t_min = std::max(t_min, std::min(ty1, ty2));
-    t_max = std::min(t_max, std::max(ty1, ty2));
-
-    if (t_min >= t_max) return false;
-
-    float tz1 = (z.min - ray.origin.z) * inv_dir.z;
-    float tz2 = (z.max - ray.origin.z) * inv_dir.z;
-
-    t_min = std::max(t_min, std::min(tz1, tz2));
-    t_max = std::min(t_max, std::max(tz1, tz2));
-
-    return t_min < t_max;
+    float tx0 = ((ray.sign[0] ? x.max : x.min) - ray.origin.x) *
+                ray.inv_direction.x;
+    float tx1 = ((ray.sign[0] ? x.min : x.max) - ray.origin.x) *
+                ray.inv_direction.x;
+    float ty0 = ((ray.sign[1] ? y.max : y.min) - ray.origin.y) *
+                ray.inv_direction.y;
+    float ty1 = ((ray.sign[1] ? y.min : y.max) - ray.origin.y) *
+                ray.inv_direction.y;
+    float tz0 = ((ray.sign[2] ? z.max : z.min) - ray.origin.z) *
+                ray.inv_direction.z;
+    float tz1 = ((ray.sign[2] ? z.min : z.max) - ray.origin.z) *
+                ray.inv_direction.z;
+
+    // An axis the ray is parallel to gives NaN (0 * inf) when the origin
+    // lies on one of its slab planes. std::max and std::min return their
+    // first argument when the second is NaN, so the slab terms go second
+    // and such an axis does not cull the box.
+    float t_enter = std::max(std::max(std::max(ray.t_min, tx0), ty0), tz0);
+    float t_exit = std::min(std::min(std::min(ray.t_max, tx1), ty1), tz1);
+    return t_enter < t_exit;
   }
 
   Vec3 centroid() const {
@@ -112,6 +110,46 @@ class AABB {
     z.max = std::max(z.max, other.z.max);
   }
 
+  bool is_empty() const {
+    return x.min > x.max || y.min > y.max || z.min > z.max;
+  }
+
+  AABB intersection(const AABB& other) const {
+    AABB b;
+    b.x = Interval(std::max(x.min, other.x.min), std::min(x.max, other.x.max));
+    b.y = Interval(std::max(y.min, other.y.min), std::min(y.max, other.y.max));
+    b.z = Interval(std::max(z.min, other.z.min), std::min(z.max, other.z.max));
+    return b;
+  }
+
+  AABB translated(const Vec3& offset) const {
+    AABB b = *this;
+    b.x = Interval(x.min + offset.x, x.max + offset.x);
+    b.y = Interval(y.min + offset.y, y.max + offset.y);
+    b.z = Interval(z.min + offset.z, z.max + offset.z);
+    return b;
+  }
+
+  // Linear blend towards `other`; for boxes that move linearly over the
+  // shutter interval this bounds the box at time t.
+  AABB lerp(const AABB& other, float t) const {
+    AABB b;
+    b.x = Interval(x.min + t * (other.x.min - x.min),
+                   x.max + t * (other.x.max - x.max));
+    b.y = Interval(y.min + t * (other.y.min - y.min),
+                   y.max + t * (other.y.max - y.max));
+    b.z = Interval(z.min + t * (other.z.min - z.min),
+                   z.max + t * (other.z.max - z.max));
+    return b;
+  }
+
+  float surface_area() const {
+    float dx = x.max - x.min;
+    float dy = y.max - y.min;
+    float dz = z.max - z.min;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+  }
+
   int longest_axis() const {
     float dx = x.max - x.min;
     float dy = y.max - y.min;
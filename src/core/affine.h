@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "core/types.h"
+
+namespace hasmet {
+// The top three rows of an affine 4x4 matrix: a linear part and a
+// translation. Half the work of a mat4 * vec4 product per point.
+struct AffineTransform {
+  Mat3 linear{1.0f};
+  Vec3 translation{0.0f};
+
+  AffineTransform() = default;
+  explicit AffineTransform(const glm::mat4& m)
+      : linear(m), translation(m[3]) {}
+
+  // Summed in the same order as glm's mat4 * vec4, so results match the
+  // full matrix product exactly.
+  Vec3 apply_point(const Vec3& p) const {
+    return (linear[0] * p.x + linear[1] * p.y) +
+           (linear[2] * p.z + translation);
+  }
+
+  Vec3 apply_vector(const Vec3& v) const { return linear * v; }
+
+  glm::mat4 to_mat4() const {
+    glm::mat4 m(linear);
+    m[3] = glm::vec4(translation, 1.0f);
+    return m;
+  }
+};
+}  // namespace hasmet
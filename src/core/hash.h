@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hasmet {
+// 64-bit FNV-1a.
+class Hasher {
+ public:
+  void add(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 1099511628211ull;
+    }
+  }
+
+  template <typename V>
+  void add(const V& value) {
+    add(&value, sizeof(V));
+  }
+
+  void add_string(const std::string& value) {
+    add(value.size());
+    add(value.data(), value.size());
+  }
+
+  template <typename V>
+  void add_vector(const std::vector<V>& values) {
+    add(values.size());
+    add(values.data(), values.size() * sizeof(V));
+  }
+
+  // Never 0, which is reserved for "no key".
+  uint64_t finish() const { return hash_ ? hash_ : 1; }
+
+ private:
+  uint64_t hash_ = 14695981039346656037ull;
+};
+}  // namespace hasmet
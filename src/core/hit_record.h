@@ -6,6 +6,10 @@
 #include <optional>
 
 namespace hasmet {
+class Hittable;
+
+// Traversal only fills t, prim_id, bary and instance; the rest is computed
+// once for the closest hit by Hittable::finalize_hit.
 struct HitRecord {
   float t;
   Vec3 p;
@@ -14,6 +18,11 @@ struct HitRecord {
   bool front_face;
   int material_id;
   Vec2 uv{0.0f, 0.0f};
+  // Face and barycentrics of a triangle hit.
+  uint32_t prim_id = 0;
+  Vec2 bary{0.0f, 0.0f};
+  // Top-level instance that was hit.
+  const Hittable* instance = nullptr;
   const std::vector<int>* texture_ids = nullptr;
   std::optional<Color> radiance;
   
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+
+#include "integrator/tile_scheduler.h"
+
+namespace hasmet {
+// Command line settings. Empty strings and non-positive numbers (negative
+// for the split budget, where zero is meaningful) mean "use what the scene
+// file says".
+struct Options {
+  std::string scene_file;
+  std::string bvh_builder;
+  std::string bvh_layout;
+  int bvh_bin_count = 0;
+  float bvh_split_budget = -1.0f;
+  // Directory of the on-disk mesh cache; empty disables it.
+  std::string mesh_cache_dir;
+  // Frames to render; an empty range uses the scene's animation range.
+  int first_frame = 0;
+  int last_frame = -1;
+  // Log BVH shape and per-ray-type traversal counters.
+  bool stats = false;
+  // Write a traversal cost image next to each rendered image.
+  bool heatmap = false;
+  // Trace Whitted camera and shadow rays in packets.
+  bool ray_packets = true;
+  // Render path tracing cameras with the wavefront integrator.
+  bool wavefront = false;
+  // Render threads; zero uses OpenMP's default.
+  int num_threads = 0;
+  // Edge length in pixels and order of the tiles the image is rendered in.
+  int tile_size = 16;
+  TileOrder tile_order = TileOrder::Hilbert;
+  // Samples per pixel of each progressive pass; zero renders in one go.
+  int samples_per_pass = 0;
+  // Seconds between progressive previews.
+  float preview_interval = 10.0f;
+  // Relative error at which adaptive sampling retires a pixel; zero
+  // disables it. Zero sample bounds use the defaults of
+  // ProgressiveSettings.
+  float adaptive_threshold = 0.0f;
+  int min_spp = 0;
+  int max_spp = 0;
+  // Seconds each image may take to render; zero renders the camera's
+  // sample count however long that takes.
+  float time_budget = 0.0f;
+  // Seconds between checkpoints of progressive renders; zero writes none.
+  float checkpoint_interval = 0.0f;
+  // Continue each image from its checkpoint, if there is one.
+  bool resume = false;
+  // Write a sample count image next to each rendered image.
+  bool sample_count_aov = false;
+};
+}  // namespace hasmet
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <limits>
 
 #include "core/sampling.h"
@@ -8,16 +9,34 @@
 #include "interval.h"
 
 namespace hasmet {
+// What a ray is traced for; only used to split traversal statistics.
+// Cameras tag their rays, Scene::is_occluded counts as shadow, and every
+// other ray is a secondary bounce.
+enum class RayType : uint8_t { Camera, Shadow, Indirect };
+constexpr int kNumRayTypes = 3;
+
 struct Ray {
   Vec3 origin;
   Vec3 direction;
-  float time;
+  // Cached for box tests; kept in sync by set_direction.
+  Vec3 inv_direction;
+  int sign[3] = {0, 0, 0};
+  float time = 0.0f;
+  RayType type = RayType::Indirect;
   float t_min = 0.001f;
   float t_max = std::numeric_limits<float>::infinity();
 
   Ray() = default;
 
-  Ray(const Vec3& o, const Vec3& d) : origin(o), direction(d) {}
+  Ray(const Vec3& o, const Vec3& d) : origin(o) { set_direction(d); }
+
+  void set_direction(const Vec3& d) {
+    direction = d;
+    inv_direction = 1.0f / d;
+    sign[0] = inv_direction.x < 0.0f;
+    sign[1] = inv_direction.y < 0.0f;
+    sign[2] = inv_direction.z < 0.0f;
+  }
 
   Vec3 at(float t) const { return origin + t * direction; }
 };
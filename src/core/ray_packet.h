@@ -0,0 +1,55 @@
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include "core/ray.h"
+
+namespace hasmet {
+
+constexpr int kRayPacketSize = 8;
+
+// Rays traced together so they can share BVH node visits, e.g. the camera
+// rays of neighbouring pixels or their shadow rays towards one light.
+// Queries take a bit mask of the rays they apply to, so a packet may have
+// holes; ray i is bit i.
+struct RayPacket {
+  Ray rays[kRayPacketSize];
+  int size = 0;
+
+  void add(const Ray& ray) { rays[size++] = ray; }
+  uint32_t all() const { return (1u << size) - 1; }
+
+  // Lowest ray of `mask`. Queries never take an empty mask; in release
+  // builds one gets ray 0 rather than a read past the array.
+  const Ray& first(uint32_t mask) const {
+    assert(mask != 0);
+    return rays[mask ? std::countr_zero(mask) : 0];
+  }
+
+  // Whether the rays in `mask` can share node tests: their directions lie
+  // in one octant and have finite reciprocals, which the interval
+  // arithmetic of the packet traversal relies on.
+  bool is_coherent(uint32_t mask) const {
+    const Ray& first = this->first(mask);
+    for (uint32_t m = mask; m; m &= m - 1) {
+      const Ray& ray = rays[std::countr_zero(m)];
+      for (int a = 0; a < 3; ++a) {
+        if (ray.sign[a] != first.sign[a] ||
+            !std::isfinite(ray.inv_direction[a])) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+};
+
+// Calls f(i) for each set bit i of `mask`, lowest first.
+template <typename F>
+inline void for_each_ray(uint32_t mask, F&& f) {
+  for (; mask; mask &= mask - 1) f(std::countr_zero(mask));
+}
+}  // namespace hasmet
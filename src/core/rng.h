@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hasmet {
+
+// One round of the PCG generator used as a 32-bit hash: an LCG step
+// followed by PCG's xorshift output permutation.
+inline uint32_t pcg_hash(uint32_t x) {
+  uint32_t state = x * 747796405u + 2891336453u;
+  uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+// Top 24 bits of x as a float in [0, 1).
+inline float uint_to_unit_float(uint32_t x) {
+  return static_cast<float>(x >> 8) * 0x1p-24f;
+}
+
+// PCG32 (XSH-RR): 16 bytes of state and one multiply per draw.
+class Pcg32 {
+ public:
+  explicit Pcg32(uint64_t seed = 0x853c49e6748fea9bull,
+                 uint64_t stream = 0xda3e39cb94b95bdbull)
+      : inc_((stream << 1u) | 1u) {
+    next_uint();
+    state_ += seed;
+    next_uint();
+  }
+
+  uint32_t next_uint() {
+    uint64_t old = state_;
+    state_ = old * 6364136223846793005ull + inc_;
+    uint32_t xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = static_cast<uint32_t>(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+  }
+
+  float next_float() { return uint_to_unit_float(next_uint()); }
+
+ private:
+  uint64_t state_ = 0;
+  uint64_t inc_;
+};
+
+}  // namespace hasmet
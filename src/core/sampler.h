@@ -1,53 +1,38 @@
-﻿#pragma once
-#include <algorithm>
+#pragma once
+#include <cstdint>
 #include <glm/glm.hpp>
-#include <memory>
-#include <numeric>
-#include <random>
+
+#include "core/rng.h"
 
 namespace hasmet {
 
+// Counter-based sampler: a value is a hash of (pixel, sample, dimension),
+// so it does not depend on which thread draws it or in what order, and a
+// render is the same image for any thread count, tile order or pass split.
+// Callers give each random decision of a sample its own dimension.
 class Sampler {
  public:
-  static constexpr int TABLE_SIZE = 1024;
-
-  Sampler() {
-    static const int n = glm::sqrt(TABLE_SIZE);
-    std::vector<glm::vec2> temp_samples;
-    std::mt19937 gen(31);
-    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-
-    for (int i = 0; i < n; ++i) {
-      for (int j = 0; j < n; ++j) {
-        float u = (i + dist(gen)) / n;
-        float v = (j + dist(gen)) / n;
-        temp_samples.push_back({u, v});
-      }
-    }
-
-    std::shuffle(temp_samples.begin(), temp_samples.end(), gen);
-    table_ = temp_samples;
-  }
+  // Bump when the hash, or the dimensions the integrators draw their
+  // decisions from, change; samples of other layouts do not mix with these
+  // (see io/checkpoint.h).
+  static constexpr uint32_t kLayoutVersion = 1;
 
+  // Two values for `dimension`, independent of each other and of get_1d.
   glm::vec2 get_2d(int pixel_id, int sample_idx, int dimension) const {
-    return glm::vec2(get_1d(pixel_id, sample_idx, dimension), 
-                         get_1d(pixel_id, sample_idx, dimension));
+    uint32_t h = hash(pixel_id, sample_idx, dimension);
+    return glm::vec2(uint_to_unit_float(pcg_hash(h ^ 0x9e3779b9u)),
+                     uint_to_unit_float(pcg_hash(h ^ 0x7f4a7c15u)));
   }
 
   float get_1d(int pixel_id, int sample_idx, int dimension) const {
-    static thread_local std::mt19937 gen(std::random_device{}());
-        static thread_local std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-        return dist(gen);
+    return uint_to_unit_float(hash(pixel_id, sample_idx, dimension));
   }
 
  private:
-  std::vector<glm::vec2> table_;
-
-  uint32_t hash_uint32(uint32_t x) const {
-    x = ((x >> 16) ^ x) * 0x45d9f3b;
-    x = ((x >> 16) ^ x) * 0x45d9f3b;
-    x = (x >> 16) ^ x;
-    return x;
+  static uint32_t hash(int pixel_id, int sample_idx, int dimension) {
+    uint32_t h = pcg_hash(static_cast<uint32_t>(pixel_id));
+    h = pcg_hash(h + static_cast<uint32_t>(sample_idx));
+    return pcg_hash(h + static_cast<uint32_t>(dimension));
   }
 };
-}  // namespace hasmet
\ No newline at end of file
+}  // namespace hasmet
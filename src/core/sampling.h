@@ -1,12 +1,17 @@
 #pragma once
-#include <random>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "core/rng.h"
 
 namespace hasmet{
 namespace Sampling{
+// Draws from a fixed-seed stream per thread, so single-threaded callers
+// such as scene loading get the same values on every run.
 inline float _generate_random_float(float start, float end) {
-  static thread_local std::mt19937 generator(std::random_device{}());
-  std::uniform_real_distribution<float> distribution(start, end);
-  return distribution(generator);
+  static thread_local Pcg32 generator;
+  return start + (end - start) * generator.next_float();
 }
 
 inline std::vector<std::pair<float, float>> generate_jittered_samples(int num_samples) {
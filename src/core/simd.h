@@ -0,0 +1,8 @@
+#pragma once
+
+// SSE is part of the x86-64 baseline, so it is used whenever the target has
+// it; other targets fall back to the scalar paths.
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define HASMET_USE_SSE 1
+#include <immintrin.h>
+#endif
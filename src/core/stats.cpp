@@ -0,0 +1,56 @@
+#include "stats.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "core/logging.h"
+
+namespace hasmet {
+namespace {
+std::mutex registry_mutex;
+// Threads of the OpenMP pool live until exit, so entries are never removed.
+std::vector<std::unique_ptr<ThreadTraversalStats>> registry;
+
+const char* ray_type_name(int type) {
+  switch (static_cast<RayType>(type)) {
+    case RayType::Camera:
+      return "camera";
+    case RayType::Shadow:
+      return "shadow";
+    default:
+      return "indirect";
+  }
+}
+}  // namespace
+
+ThreadTraversalStats* register_traversal_stats() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  registry.push_back(std::make_unique<ThreadTraversalStats>());
+  return registry.back().get();
+}
+
+TraversalReport collect_traversal_stats() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  TraversalReport report;
+  for (const std::unique_ptr<ThreadTraversalStats>& stats : registry) {
+    for (int type = 0; type < kNumRayTypes; ++type) {
+      report[type] += stats->by_type[type];
+      stats->by_type[type] = TraversalCounters();
+    }
+  }
+  return report;
+}
+
+void log_traversal_stats(const TraversalReport& report) {
+  for (int type = 0; type < kNumRayTypes; ++type) {
+    const TraversalCounters& c = report[type];
+    if (c.rays == 0) continue;
+    double rays = static_cast<double>(c.rays);
+    LOG_INFO("Traversal " << ray_type_name(type) << ": " << c.rays
+             << " rays, " << c.nodes_visited / rays << " nodes/ray, "
+             << c.primitive_tests / rays << " tests/ray, "
+             << 100.0 * c.hits / rays << "% hit");
+  }
+}
+}  // namespace hasmet
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "core/ray.h"
+
+namespace hasmet {
+// Traversal counting costs a few percent of render time, so only builds
+// configured with -DHASMET_STATS=ON count; elsewhere the recorders below
+// compile to nothing and --stats and --heatmap have no counters to report.
+#ifdef HASMET_STATS
+constexpr bool kTraversalStats = true;
+#else
+constexpr bool kTraversalStats = false;
+#endif
+
+struct TraversalCounters {
+  uint64_t rays = 0;
+  uint64_t nodes_visited = 0;
+  uint64_t primitive_tests = 0;
+  uint64_t hits = 0;
+
+  TraversalCounters& operator+=(const TraversalCounters& other) {
+    rays += other.rays;
+    nodes_visited += other.nodes_visited;
+    primitive_tests += other.primitive_tests;
+    hits += other.hits;
+    return *this;
+  }
+};
+
+using TraversalReport = std::array<TraversalCounters, kNumRayTypes>;
+
+// Counters of one thread. Traversals add to `active`, which Scene points at
+// the bucket of the ray it is tracing, so the BLAS traversals nested in a
+// TLAS leaf are charged to the same ray type.
+struct ThreadTraversalStats {
+  TraversalReport by_type;
+  TraversalCounters* active = &by_type[static_cast<int>(RayType::Indirect)];
+  // Running total of nodes visited and primitives tested, for per-pixel
+  // cost; never reset.
+  uint64_t cost = 0;
+};
+
+ThreadTraversalStats* register_traversal_stats();
+
+inline ThreadTraversalStats& thread_traversal_stats() {
+  static thread_local ThreadTraversalStats* stats = register_traversal_stats();
+  return *stats;
+}
+
+// The thread's running cost, or 0 without kTraversalStats.
+inline uint64_t thread_traversal_cost() {
+  if constexpr (kTraversalStats) return thread_traversal_stats().cost;
+  return 0;
+}
+
+// Sums and clears the counters of all threads. Must not race with tracing.
+TraversalReport collect_traversal_stats();
+void log_traversal_stats(const TraversalReport& report);
+
+// Counts one traversal in locals and adds them to the thread's counters on
+// scope exit, so the traversal loop itself only touches registers.
+struct TraversalRecorder {
+  uint32_t nodes = 0;
+  uint32_t tests = 0;
+
+  ~TraversalRecorder() {
+    if constexpr (kTraversalStats) {
+      ThreadTraversalStats& stats = thread_traversal_stats();
+      stats.active->nodes_visited += nodes;
+      stats.active->primitive_tests += tests;
+      stats.cost += nodes + tests;
+    }
+  }
+};
+
+// Counts the rays and hits of one scene query of `type` and points the
+// thread's `active` counters at that type for the traversals it runs.
+// `tests` are primitive tests done outside of a TraversalRecorder.
+class SceneQueryRecorder {
+ public:
+  SceneQueryRecorder(RayType type, uint32_t rays, uint64_t tests) {
+    if constexpr (kTraversalStats) {
+      ThreadTraversalStats& stats = thread_traversal_stats();
+      counters_ = &stats.by_type[static_cast<int>(type)];
+      stats.active = counters_;
+      counters_->rays += rays;
+      counters_->primitive_tests += tests;
+      stats.cost += tests;
+    }
+  }
+
+  void add_hits(uint32_t hits) {
+    if constexpr (kTraversalStats) counters_->hits += hits;
+  }
+
+ private:
+  TraversalCounters* counters_ = nullptr;
+};
+}  // namespace hasmet
@@ -1,6 +1,9 @@
 #include "film.h"
 
 #include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -21,6 +24,11 @@ Film Film::operator=(Film other) {
   height_ = other.height_;
   filename_ = other.filename_;
   pixels_ = other.pixels_;
+  heatmap_ = other.heatmap_;
+  sample_sums_ = other.sample_sums_;
+  luminance_sq_sums_ = other.luminance_sq_sums_;
+  sample_counts_ = other.sample_counts_;
+  active_ = other.active_;
 
   return *this;
 }
@@ -36,6 +44,64 @@ void Film::addSample(int x, int y, const Color& color) {
   pixels_[index] = color;
 }
 
+void Film::enable_accumulation() {
+  sample_sums_.assign(width_ * height_, Color(0.0f));
+  luminance_sq_sums_.assign(width_ * height_, 0.0);
+  sample_counts_.assign(width_ * height_, 0);
+  active_.clear();
+}
+
+void Film::resolve() {
+  for (size_t i = 0; i < pixels_.size(); ++i) {
+    pixels_[i] = sample_counts_[i] > 0
+                     ? sample_sums_[i] / static_cast<float>(sample_counts_[i])
+                     : Color(0.0f);
+  }
+}
+
+float Film::relative_error(int index) const {
+  // Keeps black pixels from dividing by zero; they converge on their
+  // variance alone.
+  constexpr double kMinLuminance = 1e-3;
+  int n = sample_counts_[index];
+  if (n < 2) return std::numeric_limits<float>::infinity();
+  const Color& sum = sample_sums_[index];
+  double mean = (0.2126 * sum.r + 0.7152 * sum.g + 0.0722 * sum.b) / n;
+  double variance =
+      std::max(0.0, (luminance_sq_sums_[index] - mean * mean * n) / (n - 1));
+  return static_cast<float>(std::sqrt(variance / n) /
+                            std::max(mean, kMinLuminance));
+}
+
+int Film::update_active(float threshold) {
+  std::vector<uint8_t> above(width_ * height_);
+  for (int i = 0; i < width_ * height_; ++i) {
+    above[i] = is_active(i % width_, i / width_) && relative_error(i) > threshold;
+  }
+  // A pixel keeps sampling while any neighbour does, so isolated pixels
+  // whose few samples happened to agree do not stop early.
+  std::vector<uint8_t> active(width_ * height_, 0);
+  int count = 0;
+  for (int y = 0; y < height_; ++y) {
+    for (int x = 0; x < width_; ++x) {
+      if (!is_active(x, y)) continue;
+      bool keep = false;
+      for (int ny = std::max(0, y - 1); ny <= std::min(height_ - 1, y + 1) && !keep; ++ny) {
+        for (int nx = std::max(0, x - 1); nx <= std::min(width_ - 1, x + 1); ++nx) {
+          if (above[ny * width_ + nx]) {
+            keep = true;
+            break;
+          }
+        }
+      }
+      active[y * width_ + x] = keep;
+      count += keep;
+    }
+  }
+  active_ = std::move(active);
+  return count;
+}
+
 std::string Film::get_extension() const{
   std::string ext = filename_.substr(filename_.find_last_of(".") + 1);
   std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
@@ -43,6 +109,66 @@ std::string Film::get_extension() const{
   return std::move(ext);
 }
 
+namespace {
+// Black -> blue -> cyan -> green -> yellow -> red -> white.
+Color heat_color(float v) {
+  static const Color kRamp[] = {
+      Color(0.0f, 0.0f, 0.0f), Color(0.0f, 0.0f, 1.0f),
+      Color(0.0f, 1.0f, 1.0f), Color(0.0f, 1.0f, 0.0f),
+      Color(1.0f, 1.0f, 0.0f), Color(1.0f, 0.0f, 0.0f),
+      Color(1.0f, 1.0f, 1.0f)};
+  constexpr int kLast = static_cast<int>(std::size(kRamp)) - 1;
+  float x = std::clamp(v, 0.0f, 1.0f) * kLast;
+  int i = std::min(static_cast<int>(x), kLast - 1);
+  return glm::mix(kRamp[i], kRamp[i + 1], x - i);
+}
+}  // namespace
+
+void Film::write_heatmap() const {
+  if (heatmap_.empty()) return;
+
+  // Normalise by the 99th percentile so a few pathological pixels do not
+  // wash out the rest of the image.
+  std::vector<float> sorted = heatmap_;
+  size_t nth = sorted.size() * 99 / 100;
+  std::nth_element(sorted.begin(), sorted.begin() + nth, sorted.end());
+  float scale = sorted[nth] > 0.0f ? 1.0f / sorted[nth] : 0.0f;
+
+  std::vector<Color> colors(heatmap_.size());
+  for (size_t i = 0; i < heatmap_.size(); ++i) {
+    colors[i] = heat_color(heatmap_[i] * scale);
+  }
+
+  size_t dot = filename_.find_last_of('.');
+  std::string name = filename_.substr(0, dot) + "_heatmap.png";
+  if (write_png(name, colors, width_, height_)) {
+    LOG_INFO("Heatmap " << name << " written (white = " << sorted[nth]
+                        << " nodes + tests per pixel)");
+  } else {
+    LOG_ERROR("Failed to write heatmap to :" << name);
+  }
+}
+
+void Film::write_sample_counts() const {
+  if (sample_counts_.empty()) return;
+
+  int max_count = *std::max_element(sample_counts_.begin(), sample_counts_.end());
+  float scale = max_count > 0 ? 1.0f / max_count : 0.0f;
+  std::vector<Color> colors(sample_counts_.size());
+  for (size_t i = 0; i < sample_counts_.size(); ++i) {
+    colors[i] = heat_color(sample_counts_[i] * scale);
+  }
+
+  size_t dot = filename_.find_last_of('.');
+  std::string name = filename_.substr(0, dot) + "_spp.png";
+  if (write_png(name, colors, width_, height_)) {
+    LOG_INFO("Sample counts " << name << " written (white = " << max_count
+                              << " samples per pixel)");
+  } else {
+    LOG_ERROR("Failed to write sample counts to :" << name);
+  }
+}
+
 void Film::write() const {
   std::string ext = get_extension();  
   bool success = false;
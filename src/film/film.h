@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -16,10 +17,56 @@ class Film {
   int getWidth() const { return width_; }
   int getHeight() const { return height_; }
   std::string get_extension() const;
+
+  // Traversal cost AOV: nodes visited plus primitives tested per pixel,
+  // written as a false-colour "<image>_heatmap.png".
+  void enable_heatmap() { heatmap_.assign(width_ * height_, 0.0f); }
+  bool has_heatmap() const { return !heatmap_.empty(); }
+  void add_heatmap_sample(int x, int y, float cost) {
+    heatmap_[y * width_ + x] += cost;
+  }
+  void write_heatmap() const;
+
+  // Accumulation buffer for rendering in passes: radiance sums, sums of
+  // squared luminance and sample counts per pixel. resolve() writes the
+  // means to the image.
+  void enable_accumulation();
+  bool has_accumulation() const { return !sample_counts_.empty(); }
+  void add_sample(int x, int y, const Color& L) {
+    int index = y * width_ + x;
+    float luminance = 0.2126f * L.r + 0.7152f * L.g + 0.0722f * L.b;
+    sample_sums_[index] += L;
+    luminance_sq_sums_[index] += static_cast<double>(luminance) * luminance;
+    ++sample_counts_[index];
+  }
+  int sample_count(int x, int y) const {
+    return sample_counts_[y * width_ + x];
+  }
+  void resolve();
+
+  // Adaptive sampling: pixels whose mean is not yet good enough. All
+  // pixels are active until the first update_active call.
+  bool is_active(int x, int y) const {
+    return active_.empty() || active_[y * width_ + x];
+  }
+  // Retires every pixel whose relative error, and that of its 8
+  // neighbours, is at most `threshold`. Returns the pixels left active.
+  int update_active(float threshold);
+  // Writes the sample count AOV as a false-colour "<image>_spp.png".
+  void write_sample_counts() const;
   
   int width_;
   int height_;
   std::string filename_;
   std::vector<Color> pixels_;
+  std::vector<float> heatmap_;
+  std::vector<Color> sample_sums_;
+  std::vector<double> luminance_sq_sums_;
+  std::vector<int> sample_counts_;
+  std::vector<uint8_t> active_;
+
+ private:
+  // Standard error of the pixel's mean luminance relative to that mean.
+  float relative_error(int index) const;
 };
 } // namespace hasmet
\ No newline at end of file
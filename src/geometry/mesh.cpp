@@ -4,38 +4,260 @@
 #include "core/types.h"
 
 namespace hasmet {
-Mesh::Mesh(std::vector<Triangle>& faces) {
-  faces_ = faces;
-  blas_ = BVH<Triangle>();
-  blas_.build(faces_);
+AABB MeshTriangle::get_aabb() const {
+  const uint32_t* idx = &mesh->indices[3 * face];
+  const Vec3& p0 = mesh->positions[idx[0]];
+  const Vec3& p1 = mesh->positions[idx[1]];
+  const Vec3& p2 = mesh->positions[idx[2]];
+  return AABB(glm::min(glm::min(p0, p1), p2), glm::max(glm::max(p0, p1), p2));
+}
+
+void MeshTriangle::clip(int axis, float position, const AABB& bounds,
+                        AABB& left, AABB& right) const {
+  const uint32_t* idx = &mesh->indices[3 * face];
+  const Vec3 p[3] = {mesh->positions[idx[0]], mesh->positions[idx[1]],
+                     mesh->positions[idx[2]]};
+  left = AABB();
+  right = AABB();
+  for (int i = 0; i < 3; ++i) {
+    const Vec3& a = p[i];
+    const Vec3& b = p[(i + 1) % 3];
+    float da = a[axis] - position;
+    float db = b[axis] - position;
+    if (da <= 0.0f) left.expand(a);
+    if (da >= 0.0f) right.expand(a);
+    if ((da < 0.0f && db > 0.0f) || (da > 0.0f && db < 0.0f)) {
+      Vec3 q = glm::mix(a, b, da / (da - db));
+      q[axis] = position;
+      left.expand(q);
+      right.expand(q);
+    }
+  }
+
+  // Pad like get_aabb, then keep each side within the reference's bounds
+  // and its half-space.
+  AABB left_limit = bounds;
+  AABB right_limit = bounds;
+  Interval& left_extent =
+      axis == 0 ? left_limit.x : (axis == 1 ? left_limit.y : left_limit.z);
+  Interval& right_extent =
+      axis == 0 ? right_limit.x : (axis == 1 ? right_limit.y : right_limit.z);
+  left_extent.max = std::min(left_extent.max, position);
+  right_extent.min = std::max(right_extent.min, position);
+  if (!left.is_empty()) {
+    left.thicken();
+    left = left.intersection(left_limit);
+  }
+  if (!right.is_empty()) {
+    right.thicken();
+    right = right.intersection(right_limit);
+  }
+}
+
+Mesh::Mesh(MeshData data, const BvhBuildConfig& config)
+    : data_(std::move(data)) {
+  build(config);
+}
+
+void Mesh::update(MeshData data, const BvhBuildConfig& config) {
+  if (data.indices != data_.indices) {
+    data_ = std::move(data);
+    build(config);
+    return;
+  }
+
+  // Same topology: rewrite the packets in place and refit the BLAS.
+  data_ = std::move(data);
+  area_ = 0.0f;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(data_.num_faces()); ++i) {
+    area_ += face_area(i);
+  }
+  for (Triangle4& packet : packets_) {
+    for (int lane = 0; lane < kTrianglePacketWidth; ++lane) {
+      if (packet.face[lane] == std::numeric_limits<uint32_t>::max()) continue;
+      const uint32_t* idx = &data_.indices[3 * packet.face[lane]];
+      packet.set(lane, data_.positions[idx[0]], data_.positions[idx[1]],
+                 data_.positions[idx[2]], packet.face[lane]);
+    }
+  }
+  blas_.refit([this](int first, int count) {
+    AABB bounds;
+    for (int i = first; i < first + count; ++i) {
+      for (int lane = 0; lane < kTrianglePacketWidth; ++lane) {
+        uint32_t face = packets_[i].face[lane];
+        if (face == std::numeric_limits<uint32_t>::max()) continue;
+        bounds.expand(MeshTriangle{&data_, face}.get_aabb());
+      }
+    }
+    return bounds;
+  });
   local_aabb_ = blas_.get_root_aabb();
 }
 
+void Mesh::build(const BvhBuildConfig& config) {
+  const uint32_t num_faces = static_cast<uint32_t>(data_.num_faces());
+  std::vector<MeshTriangle> faces(num_faces);
+  area_ = 0.0f;
+  for (uint32_t i = 0; i < num_faces; ++i) {
+    faces[i] = {&data_, i};
+    area_ += face_area(i);
+  }
+  blas_.build(std::move(faces), config);
+  local_aabb_ = blas_.get_root_aabb();
+
+  packets_.clear();
+  blas_.pack_leaves([this](const MeshTriangle* leaf, int count) {
+    int first = static_cast<int>(packets_.size());
+    for (int i = 0; i < count; ++i) {
+      if (i % kTrianglePacketWidth == 0) packets_.emplace_back();
+      const uint32_t* idx = &data_.indices[3 * leaf[i].face];
+      packets_.back().set(i % kTrianglePacketWidth, data_.positions[idx[0]],
+                          data_.positions[idx[1]], data_.positions[idx[2]],
+                          leaf[i].face);
+    }
+    return std::make_pair(first, static_cast<int>(packets_.size()) - first);
+  });
+}
+
 bool Mesh::intersect(Ray& ray, HitRecord& rec) const {
-  return (blas_.intersect(ray, rec));
+  return blas_.traverse(ray, [&](int first, int count, Ray& r) {
+    bool leaf_hit = false;
+    for (int i = first; i < first + count; ++i) {
+      float t, u, v;
+      int lane = packets_[i].intersect(r, r.t_max, t, u, v);
+      if (lane < 0) continue;
+      leaf_hit = true;
+      r.t_max = t;
+      rec.t = t;
+      rec.prim_id = packets_[i].face[lane];
+      rec.bary = Vec2(u, v);
+    }
+    return leaf_hit;
+  });
 }
 
-AABB Mesh::get_aabb() const { return local_aabb_; }
+bool Mesh::occluded(const Ray& ray) const {
+  return blas_.traverse_any(ray, [&](int first, int count, const Ray& r) {
+    for (int i = first; i < first + count; ++i) {
+      if (packets_[i].occluded(r)) return true;
+    }
+    return false;
+  });
+}
+
+// Packet leaves loop over the triangle packets outermost, so each one is
+// loaded once for all rays that reach the leaf.
+uint32_t Mesh::intersect_packet(RayPacket& packet, uint32_t mask,
+                                HitRecord* recs) const {
+  return blas_.traverse_packet(
+      packet, mask,
+      [&](int first, int count, RayPacket& p, uint32_t leaf_mask) {
+        uint32_t leaf_hit = 0;
+        for (int i = first; i < first + count; ++i) {
+          for_each_ray(leaf_mask, [&](int j) {
+            Ray& r = p.rays[j];
+            float t, u, v;
+            int lane = packets_[i].intersect(r, r.t_max, t, u, v);
+            if (lane < 0) return;
+            leaf_hit |= 1u << j;
+            r.t_max = t;
+            recs[j].t = t;
+            recs[j].prim_id = packets_[i].face[lane];
+            recs[j].bary = Vec2(u, v);
+          });
+        }
+        return leaf_hit;
+      });
+}
+
+uint32_t Mesh::occluded_packet(const RayPacket& packet, uint32_t mask) const {
+  return blas_.traverse_any_packet(
+      packet, mask,
+      [&](int first, int count, const RayPacket& p, uint32_t leaf_mask) {
+        uint32_t occluded = 0;
+        for (int i = first; i < first + count && leaf_mask; ++i) {
+          for_each_ray(leaf_mask, [&](int j) {
+            if (packets_[i].occluded(p.rays[j])) occluded |= 1u << j;
+          });
+          leaf_mask &= ~occluded;
+        }
+        return occluded;
+      });
+}
+
+void Mesh::finalize_hit(const Ray& ray, HitRecord& rec) const {
+  const uint32_t* idx = &data_.indices[3 * rec.prim_id];
+  const Vec3& v0 = data_.positions[idx[0]];
+  Vec3 edge1 = data_.positions[idx[1]] - v0;
+  Vec3 edge2 = data_.positions[idx[2]] - v0;
+  float u = rec.bary.x;
+  float v = rec.bary.y;
+
+  rec.p = ray.origin + ray.direction * rec.t;
+
+  if (!data_.normals.empty()) {
+    rec.normal = glm::normalize((1.0f - u - v) * data_.normals[idx[0]] +
+                                u * data_.normals[idx[1]] +
+                                v * data_.normals[idx[2]]);
+  } else {
+    rec.normal = glm::normalize(glm::cross(edge1, edge2));
+  }
 
-float Mesh::get_area() const {
-  float total = 0.0f;
-  for (const auto& tri : faces_) {
-    total += tri.get_area();
+  if (data_.uvs.empty()) {
+    rec.uv = Vec2(0.0f);
+    return;
   }
-  return total;
+
+  const Vec2& uv0 = data_.uvs[idx[0]];
+  const Vec2& uv1 = data_.uvs[idx[1]];
+  const Vec2& uv2 = data_.uvs[idx[2]];
+  rec.uv = (1.0f - u - v) * uv0 + u * uv1 + v * uv2;
+
+  // Tangent and bitangent from the UV parameterization of the face.
+  float a = uv1.x - uv0.x;
+  float b = uv1.y - uv0.y;
+  float c = uv2.x - uv0.x;
+  float d = uv2.y - uv0.y;
+  float inv_det = 1.0f / (a * d - b * c);
+  rec.tangents[0] = glm::normalize(inv_det * (d * edge1 - b * edge2));
+  rec.tangents[1] = glm::normalize(inv_det * (-c * edge1 + a * edge2));
 }
 
+AABB Mesh::get_aabb() const { return local_aabb_; }
+
+float Mesh::face_area(uint32_t face) const {
+  const uint32_t* idx = &data_.indices[3 * face];
+  Vec3 edge1 = data_.positions[idx[1]] - data_.positions[idx[0]];
+  Vec3 edge2 = data_.positions[idx[2]] - data_.positions[idx[0]];
+  return 0.5f * glm::length(glm::cross(edge1, edge2));
+}
+
+float Mesh::get_area() const { return area_; }
+
 SurfaceSample Mesh::sample_surface(const Vec2& u) const {
   // Uniform triangle selection (not area-weighted — acceptable approximation)
-  int n = faces_.size();
+  int n = static_cast<int>(data_.num_faces());
   int idx = std::min((int)(u.x * n), n - 1);
   float u_remapped = u.x * n - idx;
 
-  SurfaceSample ss = faces_[idx].sample_surface(Vec2(u_remapped, u.y));
-  // Adjust pdf: we picked 1 of n triangles uniformly, then sampled that triangle
+  // Uniform sampling on triangle via barycentric coords
+  float su = std::sqrt(u_remapped);
+  float b0 = 1.0f - su;
+  float b1 = u.y * su;
+  float b2 = 1.0f - b0 - b1;
+
+  const uint32_t* face = &data_.indices[3 * idx];
+  const Vec3& p0 = data_.positions[face[0]];
+  const Vec3& p1 = data_.positions[face[1]];
+  const Vec3& p2 = data_.positions[face[2]];
+
+  SurfaceSample ss;
+  ss.p = b0 * p0 + b1 * p1 + b2 * p2;
+  ss.n = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+  // We picked 1 of n triangles uniformly, then sampled that triangle
   // P(point) = (1/n) * (1/tri_area) = 1 / (n * tri_area)
-  ss.pdf = 1.0f / (n * faces_[idx].get_area());
+  ss.pdf = 1.0f / (n * face_area(idx));
   return ss;
 }
 
-} // namespace hasmet
\ No newline at end of file
+} // namespace hasmet
@@ -1,24 +1,77 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
 
 #include "accelerator/bvh.h"
 #include "accelerator/hittable.h"
-#include "geometry/triangle.h"
+#include "geometry/triangle4.h"
 #include "core/types.h"
 
 namespace hasmet {
+// Indexed triangle storage. Faces are three consecutive entries of
+// `indices`. `normals` is empty for flat shading and `uvs` is empty when the
+// mesh has no texture coordinates; otherwise both match `positions`.
+struct MeshData {
+  std::vector<Vec3> positions;
+  std::vector<Vec3> normals;
+  std::vector<Vec2> uvs;
+  std::vector<uint32_t> indices;
+
+  size_t num_faces() const { return indices.size() / 3; }
+};
+
+// Face reference the BLAS is built over. After the build the leaves are
+// repacked into Triangle4 packets, which are what gets intersected.
+struct MeshTriangle {
+  const MeshData* mesh = nullptr;
+  uint32_t face = 0;
+
+  AABB get_aabb() const;
+  // Bounds of the parts of the triangle on either side of the plane
+  // `position` on `axis`, limited to `bounds`. Used by SBVH spatial splits.
+  void clip(int axis, float position, const AABB& bounds, AABB& left,
+            AABB& right) const;
+};
+
 class Mesh : public Hittable {
  public:
-  Mesh(std::vector<Triangle>& faces);
+  Mesh(MeshData data, const BvhBuildConfig& config = BvhBuildConfig());
+  // Non-copyable so the geometry has one owner.
+  Mesh(const Mesh&) = delete;
+  Mesh& operator=(const Mesh&) = delete;
 
   virtual bool intersect(Ray& ray, HitRecord& rec) const override;
+  void finalize_hit(const Ray& ray, HitRecord& rec) const override;
+  bool occluded(const Ray& ray) const override;
+  uint32_t intersect_packet(RayPacket& packet, uint32_t mask,
+                            HitRecord* recs) const override;
+  uint32_t occluded_packet(const RayPacket& packet,
+                           uint32_t mask) const override;
   virtual AABB get_aabb() const override;
   SurfaceSample sample_surface(const Vec2& u) const override;
   float get_area() const override;
 
-  BVH<Triangle> blas_;
-  std::vector<Triangle> faces_;
+  size_t num_faces() const { return data_.num_faces(); }
+
+  // Replaces the vertex data, e.g. for the next frame of a deforming mesh.
+  // With unchanged indices the BLAS is refit in place; otherwise rebuilt.
+  // Instances of the mesh need Instance::refresh_bounds afterwards.
+  void update(MeshData data, const BvhBuildConfig& config);
+
+  BVH<MeshTriangle> blas_;
  private:
+  // MeshCache fills the members directly instead of building.
+  friend class MeshCache;
+  Mesh() = default;
+
+  MeshData data_;
+  // Leaf primitives of blas_, packed per leaf.
+  std::vector<Triangle4> packets_;
   AABB local_aabb_;
+  float area_ = 0.0f;
+
+  void build(const BvhBuildConfig& config);
+  float face_area(uint32_t face) const;
 };
-} // namespace hasmet
\ No newline at end of file
+} // namespace hasmet
@@ -7,15 +7,13 @@ Plane::Plane(const Vec3& center, const Vec3& normal)
   local_aabb_ = AABB(Vec3(-INFINITY), Vec3(INFINITY));
 }
 
-bool Plane::intersect(Ray& ray, HitRecord& rec) const {
+bool Plane::hit(const Ray& ray, float& t_hit) const {
   float denom = glm::dot(normal_, ray.direction);
   if (std::abs(denom) > 1e-6f) {
     Vec3 p0l0 = center_ - ray.origin;
     float t = glm::dot(p0l0, normal_) / denom;
     if (ray.t_min <= t && ray.t_max >= t) {
-      rec.t = t;
-      rec.p = ray.origin + t * ray.direction;
-      rec.normal = glm::normalize(normal_);
+      t_hit = t;
       return true;
     }
   }
@@ -23,5 +21,19 @@ bool Plane::intersect(Ray& ray, HitRecord& rec) const {
   return false;
 }
 
+bool Plane::intersect(Ray& ray, HitRecord& rec) const {
+  return hit(ray, rec.t);
+}
+
+bool Plane::occluded(const Ray& ray) const {
+  float t;
+  return hit(ray, t);
+}
+
+void Plane::finalize_hit(const Ray& ray, HitRecord& rec) const {
+  rec.p = ray.origin + rec.t * ray.direction;
+  rec.normal = glm::normalize(normal_);
+}
+
 AABB Plane::get_aabb() const { return local_aabb_; }
 } // namespace hasmet
\ No newline at end of file
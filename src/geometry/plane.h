@@ -8,11 +8,18 @@ class Plane : public Hittable {
   Plane(const Vec3& center, const Vec3& normal);
 
   virtual bool intersect(Ray& ray, HitRecord& rec) const override;
+  void finalize_hit(const Ray& ray, HitRecord& rec) const override;
+  bool occluded(const Ray& ray) const override;
+
+  const Vec3& center() const { return center_; }
+  const Vec3& normal() const { return normal_; }
   virtual AABB get_aabb() const override;
 
  private:
   AABB local_aabb_;
   Vec3 center_;
   Vec3 normal_;
+
+  bool hit(const Ray& ray, float& t) const;
 };
 } // namespace hasmet
\ No newline at end of file
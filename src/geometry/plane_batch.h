@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "core/ray.h"
+#include "core/simd.h"
+#include "core/types.h"
+
+namespace hasmet {
+
+// World-space planes in SoA blocks of four, tested together. Unbounded
+// primitives cannot go into the TLAS, so the scene tests this batch before
+// traversal; the shrunk t_max then culls everything behind the nearest
+// plane. Padding lanes have a zero normal, which the parallel test rejects.
+class PlaneBatch {
+ public:
+  static constexpr int kWidth = 4;
+
+  void clear() {
+    blocks_.clear();
+    count_ = 0;
+  }
+
+  // `normal` is not normalized, matching the object-space test of Plane.
+  void add(const Vec3& point, const Vec3& normal) {
+    if (count_ % kWidth == 0) blocks_.emplace_back();
+    Block& block = blocks_.back();
+    int lane = count_ % kWidth;
+    for (int a = 0; a < 3; ++a) {
+      block.point[a][lane] = point[a];
+      block.normal[a][lane] = normal[a];
+    }
+    ++count_;
+  }
+
+  int size() const { return count_; }
+
+  // Index of the closest plane within [ray.t_min, ray.t_max], or -1.
+  int intersect(const Ray& ray, float& t_hit) const {
+    int best = -1;
+    float best_t = ray.t_max;
+    float ts[kWidth];
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+      int mask = blocks_[b].intersect(ray, best_t, ts);
+      for (int lane = 0; lane < kWidth; ++lane) {
+        if ((mask & (1 << lane)) && (best < 0 || ts[lane] < best_t)) {
+          best = static_cast<int>(b) * kWidth + lane;
+          best_t = ts[lane];
+        }
+      }
+    }
+    if (best >= 0) t_hit = best_t;
+    return best;
+  }
+
+  bool occluded(const Ray& ray) const {
+    float ts[kWidth];
+    for (const Block& block : blocks_) {
+      if (block.intersect(ray, ray.t_max, ts)) return true;
+    }
+    return false;
+  }
+
+ private:
+  struct alignas(16) Block {
+    float point[3][kWidth] = {};
+    float normal[3][kWidth] = {};
+
+    // Mask of lanes hit within [ray.t_min, t_max], distances in `ts`.
+    int intersect(const Ray& ray, float t_max, float ts[kWidth]) const {
+#ifdef HASMET_USE_SSE
+      __m128 denom = _mm_setzero_ps();
+      __m128 num = _mm_setzero_ps();
+      for (int a = 0; a < 3; ++a) {
+        __m128 n = _mm_load_ps(normal[a]);
+        __m128 to_point =
+            _mm_sub_ps(_mm_load_ps(point[a]), _mm_set1_ps(ray.origin[a]));
+        denom = _mm_add_ps(denom, _mm_mul_ps(n, _mm_set1_ps(ray.direction[a])));
+        num = _mm_add_ps(num, _mm_mul_ps(to_point, n));
+      }
+      __m128 t = _mm_div_ps(num, denom);
+      __m128 abs_denom = _mm_andnot_ps(_mm_set1_ps(-0.0f), denom);
+      __m128 valid = _mm_cmpgt_ps(abs_denom, _mm_set1_ps(1e-6f));
+      valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_set1_ps(ray.t_min), t));
+      valid = _mm_and_ps(valid, _mm_cmpge_ps(_mm_set1_ps(t_max), t));
+      _mm_storeu_ps(ts, t);
+      return _mm_movemask_ps(valid);
+#else
+      int mask = 0;
+      for (int lane = 0; lane < kWidth; ++lane) {
+        Vec3 n(normal[0][lane], normal[1][lane], normal[2][lane]);
+        Vec3 p(point[0][lane], point[1][lane], point[2][lane]);
+        float denom = glm::dot(n, ray.direction);
+        if (std::abs(denom) <= 1e-6f) continue;
+        ts[lane] = glm::dot(p - ray.origin, n) / denom;
+        if (ray.t_min <= ts[lane] && t_max >= ts[lane]) mask |= 1 << lane;
+      }
+      return mask;
+#endif
+    }
+  };
+
+  std::vector<Block> blocks_;
+  int count_ = 0;
+};
+
+}  // namespace hasmet
@@ -13,7 +13,7 @@ Sphere::Sphere(const Vec3& center, float radius)
                center + Vec3(radius, radius, radius));
 }
 
-bool Sphere::intersect(Ray& r, HitRecord& rec) const {
+bool Sphere::hit(const Ray& r, float& t) const {
   Vec3 oc = r.origin - center_;
 
   float a = glm::dot(r.direction, r.direction);
@@ -36,7 +36,20 @@ bool Sphere::intersect(Ray& r, HitRecord& rec) const {
     }
   }
 
-  rec.t = root;
+  t = root;
+  return true;
+}
+
+bool Sphere::intersect(Ray& r, HitRecord& rec) const {
+  return hit(r, rec.t);
+}
+
+bool Sphere::occluded(const Ray& r) const {
+  float t;
+  return hit(r, t);
+}
+
+void Sphere::finalize_hit(const Ray& r, HitRecord& rec) const {
   rec.p = r.at(rec.t);
   Vec3 outward_normal = (rec.p - center_) / radius_;
   rec.set_face_normal(r, outward_normal);
@@ -56,7 +69,6 @@ bool Sphere::intersect(Ray& r, HitRecord& rec) const {
   rec.tangents[1] = glm::normalize(B);
   
   rec.uv = Vec2(u, v);
-  return true;
 }
 
 AABB Sphere::get_aabb() const { return local_aabb_; }
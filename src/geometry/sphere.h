@@ -12,6 +12,8 @@ class Sphere : public Hittable {
   Sphere(const Vec3& center, float radius);
 
   virtual bool intersect(Ray& r, HitRecord& rec) const override;
+  void finalize_hit(const Ray& r, HitRecord& rec) const override;
+  bool occluded(const Ray& r) const override;
   virtual AABB get_aabb() const override;
   SurfaceSample sample_surface(const Vec2& u) const override;
   float get_area() const override;
@@ -20,5 +22,7 @@ class Sphere : public Hittable {
   AABB local_aabb_;
   Vec3 center_;
   float radius_;
+
+  bool hit(const Ray& r, float& t) const;
 };
 } // namespace hasmet
\ No newline at end of file
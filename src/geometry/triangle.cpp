@@ -37,7 +37,8 @@ Triangle::Triangle(const Vec3 vertices[3], const Vec3 vertex_normals[3], const V
   local_aabb_ = AABB(min_v, max_v);
 }
 
-bool Triangle::intersect(Ray& ray, HitRecord& rec) const {
+bool Triangle::hit(const Ray& ray, float& t_hit, float& u_hit,
+                   float& v_hit) const {
   Vec3 edge1 = vertices_[1] - vertices_[0];
   Vec3 edge2 = vertices_[2] - vertices_[0];
 
@@ -61,33 +62,55 @@ bool Triangle::intersect(Ray& ray, HitRecord& rec) const {
   float t = f * glm::dot(edge2, q);
 
   if (t > ray.t_min && t < ray.t_max) {
-    rec.t = t;
-    rec.p = ray.origin + ray.direction * t;
-
-    if (smooth_shading_) {
-      rec.normal =
-          glm::normalize((1.0f - u - v) * vertex_normals_[0] +
-                         u * vertex_normals_[1] + v * vertex_normals_[2]);
-    } else {
-      rec.normal = glm::normalize(glm::cross(edge1, edge2));
-    }
-
-    if (has_uvs_) {
-      rec.uv = (1.0f - u - v) * tex_coords_[0] +
-                u * tex_coords_[1] + v * tex_coords_[2];
-    } else {
-      rec.uv = Vec2(0.0f);
-    }
-
-    if (has_tangents_) {
-      rec.tangents[0] = tangents_[0];
-      rec.tangents[1] = tangents_[1];
-    }
+    t_hit = t;
+    u_hit = u;
+    v_hit = v;
     return true;
   }
   return false;
 }
 
+bool Triangle::intersect(Ray& ray, HitRecord& rec) const {
+  float t, u, v;
+  if (!hit(ray, t, u, v)) return false;
+  rec.t = t;
+  rec.bary = Vec2(u, v);
+  return true;
+}
+
+bool Triangle::occluded(const Ray& ray) const {
+  float t, u, v;
+  return hit(ray, t, u, v);
+}
+
+void Triangle::finalize_hit(const Ray& ray, HitRecord& rec) const {
+  float u = rec.bary.x;
+  float v = rec.bary.y;
+  rec.p = ray.origin + ray.direction * rec.t;
+
+  if (smooth_shading_) {
+    rec.normal =
+        glm::normalize((1.0f - u - v) * vertex_normals_[0] +
+                       u * vertex_normals_[1] + v * vertex_normals_[2]);
+  } else {
+    Vec3 edge1 = vertices_[1] - vertices_[0];
+    Vec3 edge2 = vertices_[2] - vertices_[0];
+    rec.normal = glm::normalize(glm::cross(edge1, edge2));
+  }
+
+  if (has_uvs_) {
+    rec.uv = (1.0f - u - v) * tex_coords_[0] +
+              u * tex_coords_[1] + v * tex_coords_[2];
+  } else {
+    rec.uv = Vec2(0.0f);
+  }
+
+  if (has_tangents_) {
+    rec.tangents[0] = tangents_[0];
+    rec.tangents[1] = tangents_[1];
+  }
+}
+
 AABB Triangle::get_aabb() const { return local_aabb_; }
 
 float Triangle::get_area() const {
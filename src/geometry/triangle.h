@@ -14,6 +14,8 @@ class Triangle : public Hittable {
            bool smooth_shading = false);
 
   virtual bool intersect(Ray& ray, HitRecord& rec) const override;
+  void finalize_hit(const Ray& ray, HitRecord& rec) const override;
+  bool occluded(const Ray& ray) const override;
   virtual AABB get_aabb() const override;
   SurfaceSample sample_surface(const Vec2& u) const override;
   float get_area() const override;
@@ -27,5 +29,7 @@ class Triangle : public Hittable {
   bool smooth_shading_ = false;
   bool has_uvs_ = false;
   bool has_tangents_ = false;
+
+  bool hit(const Ray& ray, float& t, float& u, float& v) const;
 };
 } // namespace hasmet 
\ No newline at end of file
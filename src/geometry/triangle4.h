@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include "core/ray.h"
+#include "core/simd.h"
+#include "core/types.h"
+
+namespace hasmet {
+
+constexpr int kTrianglePacketWidth = 4;
+
+// Up to four triangles in SoA form with the first vertex and both edges
+// precomputed, intersected together by one Möller–Trumbore pass. Unused
+// lanes have zero edges, which the determinant test rejects.
+struct alignas(16) Triangle4 {
+  float v0[3][kTrianglePacketWidth];
+  float e1[3][kTrianglePacketWidth];
+  float e2[3][kTrianglePacketWidth];
+  uint32_t face[kTrianglePacketWidth];
+
+  Triangle4() {
+    for (int a = 0; a < 3; ++a) {
+      for (int lane = 0; lane < kTrianglePacketWidth; ++lane) {
+        v0[a][lane] = e1[a][lane] = e2[a][lane] = 0.0f;
+      }
+    }
+    for (int lane = 0; lane < kTrianglePacketWidth; ++lane) {
+      face[lane] = std::numeric_limits<uint32_t>::max();
+    }
+  }
+
+  void set(int lane, const Vec3& p0, const Vec3& p1, const Vec3& p2,
+           uint32_t face_index) {
+    Vec3 edge1 = p1 - p0;
+    Vec3 edge2 = p2 - p0;
+    for (int a = 0; a < 3; ++a) {
+      v0[a][lane] = p0[a];
+      e1[a][lane] = edge1[a];
+      e2[a][lane] = edge2[a];
+    }
+    face[lane] = face_index;
+  }
+
+  // Closest hit in (ray.t_min, t_max). Returns the lane, or -1 on a miss,
+  // and writes its distance and barycentrics.
+  int intersect(const Ray& ray, float t_max, float& t_hit, float& u_hit,
+                float& v_hit) const;
+
+  bool occluded(const Ray& ray) const {
+    float t, u, v;
+    return intersect(ray, ray.t_max, t, u, v) >= 0;
+  }
+};
+
+inline int Triangle4::intersect(const Ray& ray, float t_max, float& t_hit,
+                                float& u_hit, float& v_hit) const {
+#ifdef HASMET_USE_SSE
+  const __m128 dx = _mm_set1_ps(ray.direction.x);
+  const __m128 dy = _mm_set1_ps(ray.direction.y);
+  const __m128 dz = _mm_set1_ps(ray.direction.z);
+  const __m128 e1x = _mm_load_ps(e1[0]);
+  const __m128 e1y = _mm_load_ps(e1[1]);
+  const __m128 e1z = _mm_load_ps(e1[2]);
+  const __m128 e2x = _mm_load_ps(e2[0]);
+  const __m128 e2y = _mm_load_ps(e2[1]);
+  const __m128 e2z = _mm_load_ps(e2[2]);
+
+  // h = d x e2, a = e1 . h
+  __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+  __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+  __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+  __m128 a = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)),
+      _mm_mul_ps(e1z, hz));
+  __m128 valid = _mm_or_ps(_mm_cmple_ps(a, _mm_set1_ps(-1e-8f)),
+                           _mm_cmpge_ps(a, _mm_set1_ps(1e-8f)));
+  if (_mm_movemask_ps(valid) == 0) return -1;
+
+  __m128 f = _mm_div_ps(_mm_set1_ps(1.0f), a);
+  __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(v0[0]));
+  __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(v0[1]));
+  __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(v0[2]));
+  __m128 u = _mm_mul_ps(
+      f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)),
+                    _mm_mul_ps(sz, hz)));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(u, _mm_setzero_ps()));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(u, _mm_set1_ps(1.0f)));
+
+  // q = s x e1
+  __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(e1y, sz));
+  __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(e1z, sx));
+  __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(e1x, sy));
+  __m128 v = _mm_mul_ps(
+      f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+                    _mm_mul_ps(dz, qz)));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(v, _mm_setzero_ps()));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+
+  __m128 t = _mm_mul_ps(
+      f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                    _mm_mul_ps(e2z, qz)));
+  valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, _mm_set1_ps(ray.t_min)));
+  valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(t_max)));
+
+  int mask = _mm_movemask_ps(valid);
+  if (mask == 0) return -1;
+
+  alignas(16) float ts[kTrianglePacketWidth];
+  alignas(16) float us[kTrianglePacketWidth];
+  alignas(16) float vs[kTrianglePacketWidth];
+  _mm_store_ps(ts, t);
+  _mm_store_ps(us, u);
+  _mm_store_ps(vs, v);
+#else
+  float ts[kTrianglePacketWidth];
+  float us[kTrianglePacketWidth];
+  float vs[kTrianglePacketWidth];
+  int mask = 0;
+  for (int lane = 0; lane < kTrianglePacketWidth; ++lane) {
+    Vec3 edge1(e1[0][lane], e1[1][lane], e1[2][lane]);
+    Vec3 edge2(e2[0][lane], e2[1][lane], e2[2][lane]);
+    Vec3 h = glm::cross(ray.direction, edge2);
+    float a = glm::dot(edge1, h);
+    if (a > -1e-8f && a < 1e-8f) continue;
+
+    float f = 1.0f / a;
+    Vec3 s = ray.origin - Vec3(v0[0][lane], v0[1][lane], v0[2][lane]);
+    float u = f * glm::dot(s, h);
+    if (u < 0.0f || u > 1.0f) continue;
+
+    Vec3 q = glm::cross(s, edge1);
+    float v = f * glm::dot(ray.direction, q);
+    if (v < 0.0f || u + v > 1.0f) continue;
+
+    float t = f * glm::dot(edge2, q);
+    if (t <= ray.t_min || t >= t_max) continue;
+
+    ts[lane] = t;
+    us[lane] = u;
+    vs[lane] = v;
+    mask |= 1 << lane;
+  }
+  if (mask == 0) return -1;
+#endif
+
+  int best = -1;
+  for (int lane = 0; lane < kTrianglePacketWidth; ++lane) {
+    if ((mask & (1 << lane)) && (best < 0 || ts[lane] < ts[best])) best = lane;
+  }
+  t_hit = ts[best];
+  u_hit = us[best];
+  v_hit = vs[best];
+  return best;
+}
+
+}  // namespace hasmet
@@ -0,0 +1,17 @@
+#include "integrator.h"
+
+#include "camera/camera.h"
+#include "core/timer.h"
+#include "film/film.h"
+
+namespace hasmet {
+
+void Integrator::render(const Scene& scene, Film& film,
+                        const Camera& camera) const {
+  SCOPED_TIMER("Rendering");
+  film.enable_accumulation();
+  render_samples(scene, film, camera, 0, camera.num_samples_);
+  film.resolve();
+}
+
+}  // namespace hasmet
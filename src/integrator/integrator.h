@@ -1,6 +1,7 @@
 #pragma once
 #include "core/sampler.h"
 #include "core/medium.h"
+#include "integrator/tile_scheduler.h"
 
 namespace hasmet {
 class Scene;
@@ -23,7 +24,19 @@ struct PathState {
 
 class Integrator {
  public:
+  explicit Integrator(const TileSettings& tiles = {}) : tiles_(tiles) {}
   virtual ~Integrator() = default;
-  virtual void render(const Scene& scene, Film& film, const Camera& camera) const = 0;
+
+  // Renders all of the camera's samples per pixel into film.
+  void render(const Scene& scene, Film& film, const Camera& camera) const;
+  // Adds samples [first_sample, first_sample + num_samples) of every pixel
+  // to film's accumulation buffer, which must be enabled.
+  virtual void render_samples(const Scene& scene, Film& film,
+                              const Camera& camera, int first_sample,
+                              int num_samples) const = 0;
+
+ protected:
+  // How render() splits the image between threads.
+  TileSettings tiles_;
 };
 } // namespace hasmet
\ No newline at end of file
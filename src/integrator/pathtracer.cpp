@@ -1,6 +1,7 @@
 #include "pathtracer.h"
 #include "core/hit_record.h"
 #include "core/sampling.h"
+#include "core/stats.h"
 #include "core/timer.h"
 #include "core/types.h"
 #include "film/film.h"
@@ -47,6 +48,20 @@ inline float balance_heuristic(float pdf_a, float pdf_b) {
 inline float mis_01(float pdf_a, float pdf_b) {
     return (pdf_a > 0) ? 1.0f : 0.0f;
 }
+
+// Sampler dimensions of a path: the camera's pixel and lens samples, then a
+// block per bounce with the BSDF sample, Russian roulette, and a light pick
+// and light position for each light sample.
+constexpr int kCameraDimensions = 2;
+constexpr int kBsdfDimension = 0;
+constexpr int kRouletteDimension = 1;
+constexpr int kLightDimension = 2;
+constexpr int kMaxLightSamples = 2;
+constexpr int kDimensionsPerBounce = kLightDimension + 2 * kMaxLightSamples;
+
+inline int bounce_dimension(int depth, int offset) {
+  return kCameraDimensions + depth * kDimensionsPerBounce + offset;
+}
 }
 
 float PathTracerIntegrator::mis_weight(float pdf_a, float pdf_b) const {
@@ -66,51 +81,54 @@ Vec3 local_to_world(const Vec3 &local_vector, const Vec3 &normal) {
          normal * local_vector.z;
 }
 
-void PathTracerIntegrator::render(const Scene &scene, Film &film,
-                                  const Camera &camera) const {
-  SCOPED_TIMER("Render: [Path Tracing]");
+void PathTracerIntegrator::render_samples(const Scene &scene, Film &film,
+                                          const Camera &camera,
+                                          int first_sample,
+                                          int num_samples) const {
   int width = film.getWidth();
   int height = film.getHeight();
   int samples_per_pixel = camera.num_samples_;
+  int end_sample = first_sample + num_samples;
   int max_depth = scene.render_context_.max_recursion_depth
                       ? scene.render_context_.max_recursion_depth
                       : 6;
-#pragma omp parallel
-  {
-    Sampler local_sampler;
-#pragma omp for schedule(dynamic, 10)
-    for (int y = 0; y < height; ++y) {
-      for (int x = 0; x < width; ++x) {
-        Color pixel_color(0.0f);
+  Sampler sampler;
+  TileScheduler scheduler(width, height, tiles_);
+  scheduler.run([&](const Tile &tile) {
+    for (int y = tile.y0; y < tile.y1; ++y) {
+      for (int x = tile.x0; x < tile.x1; ++x) {
+        if (!film.is_active(x, y)) continue;
         int pixel_id = y * width + x;
+        uint64_t start_cost = thread_traversal_cost();
 
-        for (int s = 0; s < camera.num_samples_; s++) {
-          SamplingContext ctx{local_sampler, pixel_id, s, camera.num_samples_};
+        for (int s = first_sample; s < end_sample; s++) {
+          SamplingContext ctx{sampler, pixel_id, s, samples_per_pixel};
           
-          glm::vec2 u_pixel = local_sampler.get_2d(pixel_id, s, 0);
-          glm::vec2 u_lens = local_sampler.get_2d(pixel_id, s, 1);
+          glm::vec2 u_pixel = sampler.get_2d(pixel_id, s, 0);
+          glm::vec2 u_lens = sampler.get_2d(pixel_id, s, 1);
 
           Ray ray = camera.generateRay(static_cast<float>(x), static_cast<float>(y), u_pixel, u_lens);
           
-          pixel_color += trace_path(ray, scene, ctx, max_depth);
+          film.add_sample(x, y, trace_path(ray, scene, ctx, max_depth));
+        }
+        if (film.has_heatmap()) {
+          film.add_heatmap_sample(
+              x, y, static_cast<float>(thread_traversal_cost() - start_cost));
         }
-        film.addSample(x, y, pixel_color / static_cast<float>(camera.num_samples_));
       }
     }
-  }
+  });
 }
 
 Color PathTracerIntegrator::trace_path(Ray &ray, const Scene &scene, SamplingContext& ctx, int max_depth) const {
     Color L(0.0f);
-    Color throughput(1.0f);
-    bool is_specular_bounce = true;
-    float prev_bsdf_pdf = 0.0f;
+    PathThroughput path;
 
     for (int depth = 0; depth < max_depth; ++depth) {
         HitRecord rec;
         if (!scene.intersect(ray, rec)) {
           if (scene.environment_light_) {
-            L += throughput * scene.environment_light_->sample_le(ray);
+            L += path.throughput * scene.environment_light_->sample_le(ray);
           }
           break;
         }
@@ -120,65 +138,82 @@ Color PathTracerIntegrator::trace_path(Ray &ray, const Scene &scene, SamplingCon
         mat.setup_bsdf(rec, bsdf);
         Vec3 woW = -glm::normalize(ray.direction);
 
-        // Emission from hitting a light surface
-        if (rec.radiance.has_value()) {
-          Color emission = rec.radiance.value();
-          if (!config_.use_nee || is_specular_bounce) {
-            // No NEE or specular bounce: full weight (NEE can't sample delta dirs)
-            L += throughput * emission;
-          } else if (config_.use_mis) {
-            // MIS: weight BSDF-sampled hit against what NEE would have given
-            float light_pdf = scene.light_pdf(ray, rec);
-            float weight = (light_pdf > 0) ? mis_weight(prev_bsdf_pdf, light_pdf) : 1.0f;
-            L += throughput * emission * weight;
+        L += path.throughput * emitted(scene, ray, rec, path);
+
+        // One light sample per vertex, and a second one with NEE.
+        for (int i = 0; i < num_light_samples(); ++i) {
+          DirectSample ds = sample_direct(scene, bsdf, rec, woW, ctx, depth, i);
+          if (ds.valid && !scene.is_occluded(ds.shadow_ray)) {
+            L += path.throughput * ds.Ld;
           }
-          // If NEE is on but MIS is off: skip emission (NEE handles it)
-        }
-        
-        L += throughput * estimate_direct(scene, bsdf, rec, woW, ctx, depth);
-        // Direct lighting via NEE
-        if (config_.use_nee) {
-          L += throughput * estimate_direct(scene, bsdf, rec, woW, ctx, depth);
         }
 
-        Vec2 u = ctx.sampler.get_2d(ctx.pixel_id, ctx.sample_index, depth + 10);
-        BxDFSample bs = bsdf.sample_f(woW, u);
+        if (!scatter(bsdf, rec, woW, ctx, depth, path, ray)) break;
+    }
 
-        if (bs.pdf <= 0.0f || luminance(bs.f) < 1e-8f) break;
+    return L;
+}
 
-        float cos_theta = std::abs(glm::dot(bs.wi, rec.normal));
-        throughput *= (bs.f * cos_theta) / bs.pdf;
-        prev_bsdf_pdf = bs.pdf;
+Color PathTracerIntegrator::emitted(const Scene &scene, const Ray &ray,
+                                    const HitRecord &rec,
+                                    const PathThroughput &path) const {
+  if (!rec.radiance.has_value()) return Color(0.0f);
+  Color emission = rec.radiance.value();
+  if (!config_.use_nee || path.specular_bounce) {
+    // No NEE or specular bounce: full weight (NEE can't sample delta dirs)
+    return emission;
+  }
+  if (config_.use_mis) {
+    // MIS: weight BSDF-sampled hit against what NEE would have given
+    float light_pdf = scene.light_pdf(ray, rec);
+    float weight = (light_pdf > 0) ? mis_weight(path.prev_bsdf_pdf, light_pdf) : 1.0f;
+    return emission * weight;
+  }
+  // If NEE is on but MIS is off: skip emission (NEE handles it)
+  return Color(0.0f);
+}
 
-        is_specular_bounce = (bs.sampled_type & BSDF_SPECULAR) != 0;
+bool PathTracerIntegrator::scatter(const BSDF &bsdf, const HitRecord &rec,
+                                   const Vec3 &woW, SamplingContext &ctx,
+                                   int depth, PathThroughput &path,
+                                   Ray &ray) const {
+  Vec2 u = ctx.sampler.get_2d(ctx.pixel_id, ctx.sample_index, bounce_dimension(depth, kBsdfDimension));
+  BxDFSample bs = bsdf.sample_f(woW, u);
 
-        if (config_.use_rr && depth >= 3) {
-          float p_live = std::min(luminance(throughput), 0.99f);
-          if (ctx.sampler.get_1d(ctx.pixel_id, ctx.sample_index, depth + 50) > p_live) break;
-          throughput /= p_live;
-        }
+  if (bs.pdf <= 0.0f || luminance(bs.f) < 1e-8f) return false;
 
-        ray = Ray(rec.p + bs.wi * 0.0001f, bs.wi);
-    }
+  float cos_theta = std::abs(glm::dot(bs.wi, rec.normal));
+  path.throughput *= (bs.f * cos_theta) / bs.pdf;
+  path.prev_bsdf_pdf = bs.pdf;
 
-    return L;
+  path.specular_bounce = (bs.sampled_type & BSDF_SPECULAR) != 0;
+
+  if (config_.use_rr && depth >= 3) {
+    float p_live = std::min(luminance(path.throughput), 0.99f);
+    if (ctx.sampler.get_1d(ctx.pixel_id, ctx.sample_index, bounce_dimension(depth, kRouletteDimension)) > p_live) return false;
+    path.throughput /= p_live;
+  }
+
+  ray = Ray(rec.p + bs.wi * 0.0001f, bs.wi);
+  return true;
 }
 
-Color PathTracerIntegrator::estimate_direct(const Scene& scene, const BSDF& bsdf, const HitRecord& rec, const Vec3& woW, SamplingContext& ctx, int depth) const {
-  Color Ld(0.0f);
+PathTracerIntegrator::DirectSample PathTracerIntegrator::sample_direct(const Scene& scene, const BSDF& bsdf, const HitRecord& rec, const Vec3& woW, SamplingContext& ctx, int depth, int light_sample) const {
+  DirectSample ds;
 
   int num_point = static_cast<int>(scene.point_lights_.size());
   int num_area = static_cast<int>(scene.area_lights_.size());
   int num_spot = static_cast<int>(scene.spot_lights_.size());
   int num_object = static_cast<int>(scene.light_indices_.size());
   int total_lights = num_point + num_area + num_spot + num_object;
-  if (total_lights == 0) return Ld;
+  if (total_lights == 0) return ds;
 
   float light_pick_pdf = 1.0f / total_lights;
-  int rand_idx = static_cast<int>(ctx.sampler.get_1d(ctx.pixel_id, ctx.sample_index, depth + 200) * total_lights);
+  int dimension = bounce_dimension(depth, kLightDimension + 2 * light_sample);
+  int rand_idx = static_cast<int>(ctx.sampler.get_1d(ctx.pixel_id, ctx.sample_index, dimension) * total_lights);
   rand_idx = std::min(rand_idx, total_lights - 1);
 
-  Vec2 u_light = ctx.sampler.get_2d(ctx.pixel_id, ctx.sample_index, depth + 300);
+  Vec2 u_light = ctx.sampler.get_2d(ctx.pixel_id, ctx.sample_index, dimension + 1);
   LightSample ls;
   bool is_delta_light = false;
 
@@ -198,25 +233,24 @@ Color PathTracerIntegrator::estimate_direct(const Scene& scene, const BSDF& bsdf
 
   if (ls.pdf > 0 && luminance(ls.L) > 1e-8f) {
       Vec3 bias_normal = glm::dot(rec.normal, ls.wi) > 0 ? rec.normal : -rec.normal;
-      Ray shadow_ray(rec.p + bias_normal * 1e-4f, ls.wi);
-      shadow_ray.t_max = ls.dist - 2e-4f;
+      ds.shadow_ray = Ray(rec.p + bias_normal * 1e-4f, ls.wi);
+      ds.shadow_ray.t_max = ls.dist - 2e-4f;
 
-      if (!scene.is_occluded(shadow_ray)) {
-          float cos_theta = std::max(0.0f, glm::dot(rec.normal, ls.wi));
-          Color f = bsdf.f(woW, ls.wi);
+      float cos_theta = std::max(0.0f, glm::dot(rec.normal, ls.wi));
+      Color f = bsdf.f(woW, ls.wi);
 
-          float light_pdf = ls.pdf * light_pick_pdf;
-          float weight = 1.0f;
+      float light_pdf = ls.pdf * light_pick_pdf;
+      float weight = 1.0f;
 
-          if (!is_delta_light && config_.use_mis) {
-            float bsdf_pdf = bsdf.pdf(woW, ls.wi);
-            weight = mis_weight(light_pdf, bsdf_pdf);
-          }
-
-          Ld = (f * ls.L * cos_theta * weight) / light_pdf;
+      if (!is_delta_light && config_.use_mis) {
+        float bsdf_pdf = bsdf.pdf(woW, ls.wi);
+        weight = mis_weight(light_pdf, bsdf_pdf);
       }
+
+      ds.Ld = (f * ls.L * cos_theta * weight) / light_pdf;
+      ds.valid = true;
   }
 
-  return Ld;
+  return ds;
 }
 } // namespace hasmet
\ No newline at end of file
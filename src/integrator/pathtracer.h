@@ -14,16 +14,44 @@ struct ShadingContext;
 
 class PathTracerIntegrator : public Integrator {
  public:
-  PathTracerIntegrator() = default;
+  explicit PathTracerIntegrator(const TileSettings& tiles = {})
+      : Integrator(tiles) {}
 
   void configure(const std::vector<std::string>& params);
 
-  virtual void render(const Scene& scene, Film& film,
-                      const Camera& camera) const override;
+  virtual void render_samples(const Scene& scene, Film& film,
+                              const Camera& camera, int first_sample,
+                              int num_samples) const override;
+
+ protected:
+  // What a path carries from one vertex to the next.
+  struct PathThroughput {
+    Color throughput{1.0f};
+    float prev_bsdf_pdf = 0.0f;
+    bool specular_bounce = true;
+  };
+
+  // A light sample whose contribution Ld counts if shadow_ray is
+  // unoccluded.
+  struct DirectSample {
+    Ray shadow_ray;
+    Color Ld{0.0f};
+    bool valid = false;
+  };
+
+  // Light samples per path vertex. The unconditional one predates NEE,
+  // which adds a second.
+  int num_light_samples() const { return config_.use_nee ? 2 : 1; }
 
- private:
   Color trace_path(Ray& ray, const Scene& scene, SamplingContext& ctx, int max_depth) const;
-  Color estimate_direct(const Scene& scene, const BSDF& bsdf, const HitRecord& rec, const Vec3& woW, SamplingContext& ctx, int depth) const;
+  // Emission of a light surface hit by `ray`, MIS-weighted against NEE.
+  Color emitted(const Scene& scene, const Ray& ray, const HitRecord& rec, const PathThroughput& path) const;
+  // Light sample number `light_sample` of the vertex at `depth`, which picks
+  // its sampler dimensions.
+  DirectSample sample_direct(const Scene& scene, const BSDF& bsdf, const HitRecord& rec, const Vec3& woW, SamplingContext& ctx, int depth, int light_sample) const;
+  // Samples the BSDF for the next segment, updating `path` and `ray`.
+  // Returns false if the path ends here, including by Russian roulette.
+  bool scatter(const BSDF& bsdf, const HitRecord& rec, const Vec3& woW, SamplingContext& ctx, int depth, PathThroughput& path, Ray& ray) const;
   float mis_weight(float pdf_a, float pdf_b) const;
   Sampler sampler_;
 
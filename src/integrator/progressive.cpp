@@ -0,0 +1,140 @@
+#include "progressive.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <limits>
+
+#include "camera/camera.h"
+#include "core/logging.h"
+#include "core/timer.h"
+#include "film/film.h"
+#include "integrator/integrator.h"
+#include "io/checkpoint.h"
+
+namespace hasmet {
+
+namespace {
+std::atomic<bool> stop_requested{false};
+
+void handle_sigint(int) {
+  stop_requested.store(true);
+  std::signal(SIGINT, SIG_DFL);
+}
+}  // namespace
+
+void install_progressive_stop_handler() { std::signal(SIGINT, handle_sigint); }
+
+bool progressive_render_stopped() { return stop_requested.load(); }
+
+int render_progressive(const Integrator& integrator, const Scene& scene,
+                       Film& film, const Camera& camera,
+                       const ProgressiveSettings& settings,
+                       const std::function<void(const Film&)>& preview) {
+  using Clock = std::chrono::steady_clock;
+  SCOPED_TIMER("Rendering");
+  film.enable_accumulation();
+
+  bool adaptive = settings.adaptive_threshold > 0.0f;
+  bool budgeted = settings.deadline != Clock::time_point::max();
+  int64_t num_pixels = static_cast<int64_t>(film.getWidth()) * film.getHeight();
+  // Samples per pixel of the next pass, and for adaptive sampling the
+  // samples of all pixels together.
+  int total = camera.num_samples_;
+  int64_t sample_budget = std::numeric_limits<int64_t>::max();
+  if (adaptive || budgeted) total = std::numeric_limits<int>::max();
+  if (adaptive && !budgeted) sample_budget = camera.num_samples_ * num_pixels;
+  if ((adaptive || budgeted) && settings.max_samples > 0) {
+    total = settings.max_samples;
+  }
+  int samples_per_pass = std::max(1, settings.samples_per_pass);
+  auto last_preview = Clock::now();
+  auto last_checkpoint = last_preview;
+  bool checkpoints = !settings.checkpoint_path.empty();
+  int done = 0;
+  if (settings.resume && read_checkpoint(settings.checkpoint_path, settings.checkpoint_key,
+                                         adaptive, film, done)) {
+    LOG_INFO("Resuming from " << settings.checkpoint_path << " at " << done
+                              << " samples per pixel");
+  }
+  int64_t spent = 0;
+  int64_t num_active = 0;
+  for (int y = 0; y < film.getHeight(); ++y) {
+    for (int x = 0; x < film.getWidth(); ++x) {
+      spent += film.sample_count(x, y);
+      if (film.is_active(x, y)) ++num_active;
+    }
+  }
+  auto finished = [&] {
+    return done >= total || spent >= sample_budget || num_active == 0;
+  };
+  while (!finished() && !stop_requested.load() &&
+         Clock::now() < settings.deadline) {
+    int count = std::min(samples_per_pass, total - done);
+    // The last pass of a sample budget only takes what is left of it.
+    int64_t left = (sample_budget - spent) / num_active;
+    count = static_cast<int>(std::max<int64_t>(1, std::min<int64_t>(count, left)));
+    integrator.render_samples(scene, film, camera, done, count);
+    done += count;
+    spent += num_active * count;
+    if (adaptive && done >= settings.min_samples && !finished()) {
+      num_active = film.update_active(settings.adaptive_threshold);
+    }
+
+    std::chrono::duration<float> since_preview = Clock::now() - last_preview;
+    if (!finished() && settings.preview_interval > 0.0f &&
+        since_preview.count() >= settings.preview_interval) {
+      film.resolve();
+      LOG_INFO("Preview at " << done << " samples per pixel");
+      preview(film);
+      last_preview = Clock::now();
+    }
+
+    std::chrono::duration<float> since_checkpoint = Clock::now() - last_checkpoint;
+    if (checkpoints && !finished() && settings.checkpoint_interval > 0.0f &&
+        since_checkpoint.count() >= settings.checkpoint_interval) {
+      write_checkpoint(settings.checkpoint_path, settings.checkpoint_key, film,
+                       done);
+      last_checkpoint = Clock::now();
+    }
+  }
+  if (checkpoints) {
+    write_checkpoint(settings.checkpoint_path, settings.checkpoint_key, film,
+                     done);
+  }
+
+  if (stop_requested.load() && !finished()) {
+    if (sample_budget != std::numeric_limits<int64_t>::max()) {
+      LOG_WARN("Stopped after " << spent << " of " << sample_budget
+                                << " samples");
+    } else {
+      LOG_WARN("Stopped after " << done << " of " << total
+                                << " samples per pixel");
+    }
+  }
+  if (adaptive || budgeted) {
+    // The last pass of a budget may stop part way, so counts differ by
+    // pixel even without adaptive sampling.
+    int64_t samples = 0;
+    int min_count = std::numeric_limits<int>::max();
+    int max_count = 0;
+    for (int y = 0; y < film.getHeight(); ++y) {
+      for (int x = 0; x < film.getWidth(); ++x) {
+        int count = film.sample_count(x, y);
+        samples += count;
+        min_count = std::min(min_count, count);
+        max_count = std::max(max_count, count);
+      }
+    }
+    LOG_INFO("Rendered "
+             << static_cast<double>(samples) / (film.getWidth() * film.getHeight())
+             << " samples per pixel on average (" << min_count << " to "
+             << max_count << ")");
+  }
+  film.resolve();
+  return done;
+}
+
+}  // namespace hasmet
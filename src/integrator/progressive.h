@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace hasmet {
+class Camera;
+class Film;
+class Integrator;
+class Scene;
+
+struct ProgressiveSettings {
+  // Samples per pixel added by each pass.
+  int samples_per_pass = 4;
+  // Seconds between previews; zero writes none.
+  float preview_interval = 0.0f;
+  // Adaptive sampling: once a pixel has min_samples, it stops when its
+  // relative error is at most adaptive_threshold (see Film::update_active)
+  // and takes at most max_samples. The render gets the camera's samples
+  // per pixel times the pixel count in total, and what retired pixels do
+  // not use goes to those still active in further passes. A zero threshold
+  // gives every pixel the camera's samples; a zero max_samples means no
+  // per-pixel limit.
+  float adaptive_threshold = 0.0f;
+  int min_samples = 16;
+  int max_samples = 0;
+  // Time-budgeted rendering: passes go on until the deadline instead of
+  // ending at the camera's sample count, which then no longer applies.
+  // The integrator's TileSettings should carry the same deadline so the
+  // last pass stops there too.
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::time_point::max();
+  // Checkpoints (see io/checkpoint.h) go to checkpoint_path every
+  // checkpoint_interval seconds and when the render ends; an empty path
+  // writes none. With resume, a checkpoint found there with the same
+  // checkpoint_key is loaded first and the render goes on from its next
+  // sample.
+  std::string checkpoint_path;
+  uint64_t checkpoint_key = 0;
+  float checkpoint_interval = 0.0f;
+  bool resume = false;
+};
+
+// Renders the camera's samples in passes of settings.samples_per_pass into
+// film's accumulation buffer, calling preview(film) with the image so far
+// every settings.preview_interval seconds. On Ctrl-C (see
+// install_progressive_stop_handler) it stops after the current pass, and
+// film holds the image of the samples rendered so far. Returns the most
+// samples any pixel got.
+int render_progressive(const Integrator& integrator, const Scene& scene,
+                       Film& film, const Camera& camera,
+                       const ProgressiveSettings& settings,
+                       const std::function<void(const Film&)>& preview);
+
+// Makes the first SIGINT stop render_progressive after the current pass
+// instead of killing the process. A second one kills it as usual.
+void install_progressive_stop_handler();
+// Whether rendering was stopped that way; later renders should not start.
+bool progressive_render_stopped();
+
+}  // namespace hasmet
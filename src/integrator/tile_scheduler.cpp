@@ -0,0 +1,81 @@
+#include "tile_scheduler.h"
+
+#include <stdexcept>
+
+namespace hasmet {
+
+namespace {
+// Position of (x, y) along the Hilbert curve over an n x n grid, n a power
+// of two.
+uint64_t hilbert_index(uint32_t n, uint32_t x, uint32_t y) {
+  uint64_t d = 0;
+  for (uint32_t s = n / 2; s > 0; s /= 2) {
+    uint32_t rx = (x & s) ? 1 : 0;
+    uint32_t ry = (y & s) ? 1 : 0;
+    d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+uint64_t spread_bits(uint32_t v) {
+  uint64_t x = v;
+  x = (x | x << 16) & 0x0000ffff0000ffffull;
+  x = (x | x << 8) & 0x00ff00ff00ff00ffull;
+  x = (x | x << 4) & 0x0f0f0f0f0f0f0f0full;
+  x = (x | x << 2) & 0x3333333333333333ull;
+  x = (x | x << 1) & 0x5555555555555555ull;
+  return x;
+}
+
+uint64_t morton_index(uint32_t x, uint32_t y) {
+  return spread_bits(x) | spread_bits(y) << 1;
+}
+}  // namespace
+
+TileOrder parse_tile_order(std::string name) {
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  if (name == "hilbert") return TileOrder::Hilbert;
+  if (name == "morton") return TileOrder::Morton;
+  if (name == "scanline") return TileOrder::Scanline;
+  throw std::runtime_error("Unsupported tile order: " + name);
+}
+
+TileScheduler::TileScheduler(int width, int height,
+                             const TileSettings& settings)
+    : deadline_(settings.deadline) {
+  int size = std::max(1, settings.size);
+  int tiles_x = (width + size - 1) / size;
+  int tiles_y = (height + size - 1) / size;
+  uint32_t n = 1;
+  while (n < static_cast<uint32_t>(std::max(tiles_x, tiles_y))) n *= 2;
+
+  std::vector<std::pair<uint64_t, Tile>> keyed;
+  keyed.reserve(static_cast<size_t>(tiles_x) * tiles_y);
+  for (int ty = 0; ty < tiles_y; ++ty) {
+    for (int tx = 0; tx < tiles_x; ++tx) {
+      Tile tile{tx * size, ty * size, std::min((tx + 1) * size, width),
+                std::min((ty + 1) * size, height)};
+      uint64_t key = static_cast<uint64_t>(ty) * tiles_x + tx;
+      if (settings.order == TileOrder::Morton) {
+        key = morton_index(tx, ty);
+      } else if (settings.order == TileOrder::Hilbert) {
+        key = hilbert_index(n, tx, ty);
+      }
+      keyed.emplace_back(key, tile);
+    }
+  }
+  std::sort(keyed.begin(), keyed.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  tiles_.reserve(keyed.size());
+  for (const auto& [key, tile] : keyed) tiles_.push_back(tile);
+}
+
+}  // namespace hasmet
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <omp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace hasmet {
+
+// Order in which tiles are handed out. The space-filling curves keep tiles
+// rendered close in time close on screen, so consecutive tiles of a thread
+// reuse the BVH nodes and textures the previous ones pulled into cache.
+enum class TileOrder { Scanline, Morton, Hilbert };
+
+struct TileSettings {
+  int size = 16;
+  TileOrder order = TileOrder::Hilbert;
+  // Tiles not started by then are skipped, so a time-budgeted render keeps
+  // every thread busy up to its deadline and only finishes the tiles in
+  // flight.
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::time_point::max();
+};
+
+// "hilbert", "morton" or "scanline"; throws on anything else.
+TileOrder parse_tile_order(std::string name);
+
+// Pixels [x0, x1) x [y0, y1).
+struct Tile {
+  int x0, y0, x1, y1;
+};
+
+// Splits an image into square tiles and runs them on all OpenMP threads.
+// Each thread starts on its own contiguous run of the tile order and, once
+// that is done, steals single tiles from the far end of the others' runs,
+// so expensive regions get shared out without the threads fighting over
+// neighbouring tiles.
+class TileScheduler {
+ public:
+  TileScheduler(int width, int height, const TileSettings& settings);
+
+  const std::vector<Tile>& tiles() const { return tiles_; }
+
+  // Calls f(tile) once for every tile, in parallel, or for those started
+  // before the deadline.
+  template <typename F>
+  void run(F&& f) const;
+
+ private:
+  // A thread's remaining run [begin, end) of tile indices, packed into one
+  // word so the owner taking from the front and thieves taking from the
+  // back agree on every tile.
+  struct alignas(64) TileQueue {
+    std::atomic<uint64_t> range{0};
+
+    void reset(uint32_t begin, uint32_t end) {
+      range.store(static_cast<uint64_t>(begin) << 32 | end,
+                  std::memory_order_relaxed);
+    }
+    int pop_front();
+    int pop_back();
+  };
+
+  std::vector<Tile> tiles_;
+  std::chrono::steady_clock::time_point deadline_;
+};
+
+inline int TileScheduler::TileQueue::pop_front() {
+  uint64_t r = range.load(std::memory_order_relaxed);
+  for (;;) {
+    uint32_t begin = static_cast<uint32_t>(r >> 32);
+    uint32_t end = static_cast<uint32_t>(r);
+    if (begin >= end) return -1;
+    uint64_t next = static_cast<uint64_t>(begin + 1) << 32 | end;
+    if (range.compare_exchange_weak(r, next, std::memory_order_relaxed)) {
+      return static_cast<int>(begin);
+    }
+  }
+}
+
+inline int TileScheduler::TileQueue::pop_back() {
+  uint64_t r = range.load(std::memory_order_relaxed);
+  for (;;) {
+    uint32_t begin = static_cast<uint32_t>(r >> 32);
+    uint32_t end = static_cast<uint32_t>(r);
+    if (begin >= end) return -1;
+    uint64_t next = static_cast<uint64_t>(begin) << 32 | (end - 1);
+    if (range.compare_exchange_weak(r, next, std::memory_order_relaxed)) {
+      return static_cast<int>(end - 1);
+    }
+  }
+}
+
+template <typename F>
+void TileScheduler::run(F&& f) const {
+  int num_tiles = static_cast<int>(tiles_.size());
+  int num_threads = std::max(1, std::min(omp_get_max_threads(), num_tiles));
+  std::unique_ptr<TileQueue[]> queues(new TileQueue[num_threads]);
+  for (int t = 0; t < num_threads; ++t) {
+    queues[t].reset(static_cast<uint32_t>(int64_t(num_tiles) * t / num_threads),
+                    static_cast<uint32_t>(int64_t(num_tiles) * (t + 1) / num_threads));
+  }
+
+  bool has_deadline = deadline_ != std::chrono::steady_clock::time_point::max();
+  // Threads the runtime does not start leave their runs to be stolen.
+#pragma omp parallel num_threads(num_threads)
+  {
+    int self = omp_get_thread_num();
+    for (;;) {
+      int index = queues[self].pop_front();
+      for (int i = 1; index < 0 && i < num_threads; ++i) {
+        index = queues[(self + i) % num_threads].pop_back();
+      }
+      if (index < 0) break;
+      if (has_deadline && std::chrono::steady_clock::now() >= deadline_) break;
+      f(tiles_[index]);
+    }
+  }
+}
+
+}  // namespace hasmet
@@ -0,0 +1,206 @@
+#include "wavefront.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "camera/camera.h"
+#include "core/stats.h"
+#include "film/film.h"
+#include "material/bsdf.h"
+#include "material/material.h"
+#include "scene/scene.h"
+
+namespace hasmet {
+
+void WavefrontPathTracerIntegrator::Wave::resize(int size, int light_samples) {
+  rays.resize(size);
+  hits.resize(size);
+  throughput.resize(size);
+  prev_bsdf_pdf.resize(size);
+  specular_bounce.resize(size);
+  alive.resize(size);
+  L.resize(size);
+  pixel_id.resize(size);
+  sample_index.resize(size);
+  cost.resize(size);
+  active.reserve(size);
+  shade_queue.reserve(size);
+  shadow_rays.resize(static_cast<size_t>(size) * light_samples);
+  shadow_L.resize(static_cast<size_t>(size) * light_samples);
+}
+
+void WavefrontPathTracerIntegrator::render_samples(const Scene& scene,
+                                                   Film& film,
+                                                   const Camera& camera,
+                                                   int first_sample,
+                                                   int num_samples) const {
+  int width = film.getWidth();
+  int height = film.getHeight();
+  int samples_per_pixel = camera.num_samples_;
+  int max_depth = scene.render_context_.max_recursion_depth
+                      ? scene.render_context_.max_recursion_depth
+                      : 6;
+  // Path p is sample first_sample + p % num_samples of pixel
+  // pixel_order[p / num_samples]. The pixels go tile by tile, so the paths
+  // of a wave start close together on screen. Pixels that adaptive
+  // sampling has retired get none.
+  std::vector<int> pixel_order;
+  pixel_order.reserve(static_cast<size_t>(width) * height);
+  TileScheduler scheduler(width, height, tiles_);
+  for (const Tile& tile : scheduler.tiles()) {
+    for (int y = tile.y0; y < tile.y1; ++y) {
+      for (int x = tile.x0; x < tile.x1; ++x) {
+        if (film.is_active(x, y)) pixel_order.push_back(y * width + x);
+      }
+    }
+  }
+  int64_t num_paths = static_cast<int64_t>(pixel_order.size()) * num_samples;
+  if (num_paths == 0) return;
+
+  Sampler sampler;
+  Wave wave;
+  wave.samples_per_pixel = samples_per_pixel;
+  wave.resize(static_cast<int>(std::min<int64_t>(kWaveSize, num_paths)),
+              num_light_samples());
+
+  bool has_deadline = tiles_.deadline != std::chrono::steady_clock::time_point::max();
+  for (int64_t first = 0; first < num_paths; first += kWaveSize) {
+    if (has_deadline && std::chrono::steady_clock::now() >= tiles_.deadline) break;
+    int size = static_cast<int>(std::min<int64_t>(kWaveSize, num_paths - first));
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < size; ++i) {
+      int64_t path = first + i;
+      int pixel_id = pixel_order[path / num_samples];
+      int s = first_sample + static_cast<int>(path % num_samples);
+      glm::vec2 u_pixel = sampler.get_2d(pixel_id, s, 0);
+      glm::vec2 u_lens = sampler.get_2d(pixel_id, s, 1);
+      wave.rays[i] = camera.generateRay(static_cast<float>(pixel_id % width),
+                                        static_cast<float>(pixel_id / width),
+                                        u_pixel, u_lens);
+      wave.throughput[i] = Color(1.0f);
+      wave.prev_bsdf_pdf[i] = 0.0f;
+      wave.specular_bounce[i] = 1;
+      wave.L[i] = Color(0.0f);
+      wave.pixel_id[i] = pixel_id;
+      wave.sample_index[i] = s;
+      wave.cost[i] = 0;
+    }
+    wave.active.resize(size);
+    for (int i = 0; i < size; ++i) wave.active[i] = i;
+
+    for (int depth = 0; depth < max_depth && !wave.active.empty(); ++depth) {
+      extend(scene, wave);
+      logic(scene, wave);
+      shade(scene, sampler, depth, wave);
+      connect(scene, wave);
+
+      wave.active.clear();
+      for (int slot : wave.shade_queue) {
+        if (wave.alive[slot]) wave.active.push_back(slot);
+      }
+    }
+
+    for (int i = 0; i < size; ++i) {
+      int x = wave.pixel_id[i] % width;
+      int y = wave.pixel_id[i] / width;
+      film.add_sample(x, y, wave.L[i]);
+      if (film.has_heatmap()) {
+        film.add_heatmap_sample(x, y, static_cast<float>(wave.cost[i]));
+      }
+    }
+  }
+}
+
+void WavefrontPathTracerIntegrator::extend(const Scene& scene, Wave& wave) const {
+  int count = static_cast<int>(wave.active.size());
+#pragma omp parallel for schedule(dynamic, 256)
+  for (int k = 0; k < count; ++k) {
+    int slot = wave.active[k];
+    uint64_t start_cost = thread_traversal_cost();
+    // Hits fill in only what they have, e.g. radiance only on lights.
+    wave.hits[slot] = HitRecord();
+    wave.alive[slot] = scene.intersect(wave.rays[slot], wave.hits[slot]);
+    wave.cost[slot] += thread_traversal_cost() - start_cost;
+  }
+}
+
+void WavefrontPathTracerIntegrator::logic(const Scene& scene, Wave& wave) const {
+  int num_materials = static_cast<int>(scene.materials_.size());
+  std::vector<int> offsets(num_materials + 1, 0);
+
+  for (int slot : wave.active) {
+    PathThroughput path{wave.throughput[slot], wave.prev_bsdf_pdf[slot],
+                        wave.specular_bounce[slot] != 0};
+    if (!wave.alive[slot]) {
+      if (scene.environment_light_) {
+        wave.L[slot] += path.throughput * scene.environment_light_->sample_le(wave.rays[slot]);
+      }
+      continue;
+    }
+    const HitRecord& rec = wave.hits[slot];
+    wave.L[slot] += path.throughput * emitted(scene, wave.rays[slot], rec, path);
+    ++offsets[rec.material_id + 1];
+  }
+
+  // Counting sort of the hit paths by material id.
+  for (int m = 0; m < num_materials; ++m) offsets[m + 1] += offsets[m];
+  wave.shade_queue.resize(offsets[num_materials]);
+  for (int slot : wave.active) {
+    if (wave.alive[slot]) {
+      wave.shade_queue[offsets[wave.hits[slot].material_id]++] = slot;
+    }
+  }
+}
+
+void WavefrontPathTracerIntegrator::shade(const Scene& scene, Sampler& sampler,
+                                          int depth, Wave& wave) const {
+  int count = static_cast<int>(wave.shade_queue.size());
+  int light_samples = num_light_samples();
+#pragma omp parallel for schedule(dynamic, 256)
+  for (int k = 0; k < count; ++k) {
+    int slot = wave.shade_queue[k];
+    SamplingContext ctx{sampler, wave.pixel_id[slot], wave.sample_index[slot],
+                        wave.samples_per_pixel};
+    HitRecord& rec = wave.hits[slot];
+    Ray& ray = wave.rays[slot];
+
+    const Material& mat = *scene.get_material(rec.material_id);
+    BSDF bsdf(rec);
+    mat.setup_bsdf(rec, bsdf);
+    Vec3 woW = -glm::normalize(ray.direction);
+
+    PathThroughput path{wave.throughput[slot], wave.prev_bsdf_pdf[slot],
+                        wave.specular_bounce[slot] != 0};
+    for (int i = 0; i < light_samples; ++i) {
+      size_t shadow = static_cast<size_t>(k) * light_samples + i;
+      DirectSample ds = sample_direct(scene, bsdf, rec, woW, ctx, depth, i);
+      wave.shadow_rays[shadow] = ds.shadow_ray;
+      wave.shadow_L[shadow] = ds.valid ? path.throughput * ds.Ld : Color(0.0f);
+    }
+
+    wave.alive[slot] = scatter(bsdf, rec, woW, ctx, depth, path, ray);
+    wave.throughput[slot] = path.throughput;
+    wave.prev_bsdf_pdf[slot] = path.prev_bsdf_pdf;
+    wave.specular_bounce[slot] = path.specular_bounce;
+  }
+}
+
+void WavefrontPathTracerIntegrator::connect(const Scene& scene, Wave& wave) const {
+  int count = static_cast<int>(wave.shade_queue.size());
+  int light_samples = num_light_samples();
+#pragma omp parallel for schedule(dynamic, 256)
+  for (int k = 0; k < count; ++k) {
+    int slot = wave.shade_queue[k];
+    uint64_t start_cost = thread_traversal_cost();
+    for (int i = 0; i < light_samples; ++i) {
+      size_t shadow = static_cast<size_t>(k) * light_samples + i;
+      const Color& Ld = wave.shadow_L[shadow];
+      if (Ld == Color(0.0f)) continue;
+      if (!scene.is_occluded(wave.shadow_rays[shadow])) wave.L[slot] += Ld;
+    }
+    wave.cost[slot] += thread_traversal_cost() - start_cost;
+  }
+}
+
+}  // namespace hasmet
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "core/hit_record.h"
+#include "core/ray.h"
+#include "core/types.h"
+#include "integrator/pathtracer.h"
+
+namespace hasmet {
+
+// Path tracer that advances a large batch ("wave") of paths one bounce at a
+// time instead of tracing each path to the end. Every bounce runs as
+// separate passes over the wave:
+//
+//   extend   closest hits of all live path rays
+//   logic    environment light for misses, emission for hits, and a sort
+//            of the hit paths by material id
+//   shade    setup_bsdf, light samples and the next path ray, run over the
+//            sorted queue so each material's BxDFs see a homogeneous batch
+//   connect  shadow rays of the light samples
+//
+// Each pass runs one kind of work over many paths, which keeps the
+// intersection and shading code and data in cache. The estimator is that of
+// PathTracerIntegrator::trace_path.
+class WavefrontPathTracerIntegrator : public PathTracerIntegrator {
+ public:
+  // Paths in flight at a time.
+  static constexpr int kWaveSize = 1 << 16;
+
+  explicit WavefrontPathTracerIntegrator(const TileSettings& tiles = {})
+      : PathTracerIntegrator(tiles) {}
+
+  virtual void render_samples(const Scene& scene, Film& film,
+                              const Camera& camera, int first_sample,
+                              int num_samples) const override;
+
+ private:
+  // Path states of a wave in SoA form, indexed by path slot.
+  struct Wave {
+    std::vector<Ray> rays;
+    std::vector<HitRecord> hits;
+    std::vector<Color> throughput;
+    std::vector<float> prev_bsdf_pdf;
+    std::vector<uint8_t> specular_bounce;
+    // Whether a path goes on: cleared by extend when its ray misses and by
+    // shade when it ends at the hit.
+    std::vector<uint8_t> alive;
+    std::vector<Color> L;
+    std::vector<int> pixel_id;
+    std::vector<int> sample_index;
+    std::vector<uint64_t> cost;
+    int samples_per_pixel = 1;
+
+    // Slots of live paths, and of those whose ray hit something, sorted
+    // by material id.
+    std::vector<int> active;
+    std::vector<int> shade_queue;
+    // num_light_samples() shadow rays per shade_queue entry; a zero
+    // contribution marks an unused one.
+    std::vector<Ray> shadow_rays;
+    std::vector<Color> shadow_L;
+
+    void resize(int size, int light_samples);
+  };
+
+  void extend(const Scene& scene, Wave& wave) const;
+  void logic(const Scene& scene, Wave& wave) const;
+  void shade(const Scene& scene, Sampler& sampler, int depth, Wave& wave) const;
+  void connect(const Scene& scene, Wave& wave) const;
+};
+
+}  // namespace hasmet
@@ -2,10 +2,14 @@
 
 #include "whitted.h"
 
+#include <algorithm>
 #include <cmath>
+#include <optional>
 
 #include "core/hit_record.h"
+#include "core/ray_packet.h"
 #include "core/sampler.h"
+#include "core/stats.h"
 #include "core/timer.h"
 #include "core/types.h"
 #include "film/film.h"
@@ -21,43 +25,178 @@
 namespace hasmet {
 
 namespace {
-inline bool is_same_hemisphere(const glm::vec3 &v1, glm::vec3 &v2) {
+inline bool is_same_hemisphere(const glm::vec3 &v1, const glm::vec3 &v2) {
   return (glm::dot(v1, v2) > 0);
 }
+
+Color miss_radiance(const Ray &ray, const Scene &scene) {
+  if (!scene.environment_light_) {
+    return scene.render_context_.background_color;
+  }
+  return scene.environment_light_->sample_le(ray);
+}
+
+// Contribution of an unoccluded light sample.
+Color direct_radiance(const BSDF &bsdf, const HitRecord &rec, const Vec3 &woW,
+                      const LightSample &ls) {
+  Color f = bsdf.f(woW, ls.wi);
+  float cos_theta = std::max(0.0f, glm::dot(rec.normal, ls.wi));
+  return (f * ls.L * cos_theta) / ls.pdf;
+}
+
+bool is_valid(const LightSample &ls) {
+  return ls.pdf > 0.0f && glm::length(ls.L) != 0;
+}
+
+Ray make_shadow_ray(const HitRecord &rec, const LightSample &ls) {
+  Ray shadow_ray(rec.p + rec.normal * 0.0006f, ls.wi);
+  shadow_ray.t_max = ls.dist - 0.0006f;
+  return shadow_ray;
+}
+
+// Camera ray packets cover blocks of pixels rather than rows, which keeps
+// their rays closer together.
+constexpr int kPacketWidth = 4;
+constexpr int kPacketHeight = kRayPacketSize / kPacketWidth;
+
+// Calls f(light, index) for every light that shade_direct samples, with
+// index counting the lights from 0.
+template <typename F>
+void for_each_light(const Scene &scene, F &&f) {
+  int index = 0;
+  for (const auto &light : scene.point_lights_) f(*light, index++);
+  for (const auto &light : scene.area_lights_) f(*light, index++);
+  for (const auto &light : scene.spot_lights_) f(*light, index++);
+  for (const auto &light : scene.directional_lights_) f(*light, index++);
+}
+
+// Sampler dimensions: the camera's pixel, lens and time samples, then one
+// per light for each bounce.
+constexpr int kCameraDimensions = 3;
+
+int light_dimension(const Scene &scene, int bounce, int light) {
+  int num_lights = static_cast<int>(
+      scene.point_lights_.size() + scene.area_lights_.size() +
+      scene.spot_lights_.size() + scene.directional_lights_.size());
+  return kCameraDimensions + bounce * num_lights + light;
+}
 } // namespace
 
-void WhittedIntegrator::render(const Scene &scene, Film &film,
-                               const Camera &camera) const {
-  SCOPED_TIMER("Rendering");
+void WhittedIntegrator::render_samples(const Scene &scene, Film &film,
+                                       const Camera &camera, int first_sample,
+                                       int num_samples) const {
   int width = film.getWidth();
   int height = film.getHeight();
 
-#pragma omp parallel
-  {
-    Sampler local_sampler;
-#pragma omp for schedule(dynamic, 10)
-    for (int y = 0; y < height; ++y) {
-      for (int x = 0; x < width; ++x) {
-        Color pixel_color(0.0f);
-        int pixel_id = y * width + x;
-        for (int s = 0; s < camera.num_samples_; s++) {
-          SamplingContext ctx{local_sampler, pixel_id, s, camera.num_samples_};
-
-          glm::vec2 u_pixel = ctx.sampler.get_2d(pixel_id, s, 0);
-          glm::vec2 u_lens = ctx.sampler.get_2d(pixel_id, s, 1);
-          float time_sample = ctx.sampler.get_1d(pixel_id, s, 2);
-
-          Ray ray = camera.generateRay(static_cast<float>(x), static_cast<float>(y), u_pixel, u_lens);
-          ray.time = time_sample;
-
-          PathState initial_state(scene.render_context_.max_recursion_depth);
-          pixel_color += trace_ray(ray, scene, initial_state, ctx);
+  Sampler sampler;
+  TileScheduler scheduler(width, height, tiles_);
+  scheduler.run([&](const Tile &tile) {
+    // Each packet covers a kPacketWidth x kPacketHeight block of pixels,
+    // traced together once per sample.
+    for (int y0 = tile.y0; y0 < tile.y1; y0 += kPacketHeight) {
+      for (int x0 = tile.x0; x0 < tile.x1; x0 += kPacketWidth) {
+        int xs[kRayPacketSize], ys[kRayPacketSize], pixel_ids[kRayPacketSize];
+        int count = 0;
+        for (int y = y0; y < std::min(y0 + kPacketHeight, tile.y1); ++y) {
+          for (int x = x0; x < std::min(x0 + kPacketWidth, tile.x1); ++x) {
+            if (!film.is_active(x, y)) continue;
+            xs[count] = x;
+            ys[count] = y;
+            pixel_ids[count++] = y * width + x;
+          }
         }
 
-        film.addSample(x, y,pixel_color / static_cast<float>(camera.num_samples_));
+        if (count == 0) continue;
+
+        uint64_t start_cost = thread_traversal_cost();
+        for (int s = first_sample; s < first_sample + num_samples; s++) {
+          RayPacket packet;
+          for (int i = 0; i < count; ++i) {
+            glm::vec2 u_pixel = sampler.get_2d(pixel_ids[i], s, 0);
+            glm::vec2 u_lens = sampler.get_2d(pixel_ids[i], s, 1);
+            float time_sample = sampler.get_1d(pixel_ids[i], s, 2);
+
+            Ray ray = camera.generateRay(static_cast<float>(xs[i]), static_cast<float>(ys[i]), u_pixel, u_lens);
+            ray.time = time_sample;
+            packet.add(ray);
+          }
+
+          Color L[kRayPacketSize];
+          if (use_packets_) {
+            trace_packet(packet, scene, sampler, pixel_ids, s, camera.num_samples_, L);
+          } else {
+            for (int i = 0; i < count; ++i) {
+              SamplingContext ctx{sampler, pixel_ids[i], s, camera.num_samples_};
+              PathState initial_state(scene.render_context_.max_recursion_depth);
+              L[i] = trace_ray(packet.rays[i], scene, initial_state, ctx);
+            }
+          }
+          for (int i = 0; i < count; ++i) film.add_sample(xs[i], ys[i], L[i]);
+        }
+
+        // A packet's traversal cost is shared evenly by its pixels.
+        float cost = static_cast<float>(thread_traversal_cost() - start_cost) / count;
+        if (film.has_heatmap()) {
+          for (int i = 0; i < count; ++i) film.add_heatmap_sample(xs[i], ys[i], cost);
+        }
       }
     }
+  });
+}
+
+void WhittedIntegrator::trace_packet(RayPacket &packet, const Scene &scene,
+                                     Sampler &sampler, const int *pixel_ids,
+                                     int sample_index, int num_samples,
+                                     Color *L) const {
+  PathState initial_state(scene.render_context_.max_recursion_depth);
+  if (initial_state.depth <= 0) {
+    std::fill_n(L, packet.size, Color(0.0f));
+    return;
+  }
+
+  HitRecord recs[kRayPacketSize];
+  uint32_t hit = scene.intersect(packet, packet.all(), recs);
+
+  std::optional<BSDF> bsdfs[kRayPacketSize];
+  Vec3 wo[kRayPacketSize];
+  for (int i = 0; i < packet.size; ++i) {
+    if (!((hit >> i) & 1)) {
+      L[i] = miss_radiance(packet.rays[i], scene);
+      continue;
+    }
+    const Material &mat = *scene.get_material(recs[i].material_id);
+    mat.setup_bsdf(recs[i], bsdfs[i].emplace(recs[i]));
+    wo[i] = -glm::normalize(packet.rays[i].direction);
+    L[i] = mat.get_ambient_reflectance() * scene.ambient_light_->radiance;
   }
+
+  // One shadow packet per light, from all hit points at once.
+  for_each_light(scene, [&](const auto &light, int light_index) {
+    int dimension = light_dimension(scene, 0, light_index);
+    RayPacket shadow_packet;
+    shadow_packet.size = packet.size;
+    LightSample samples[kRayPacketSize];
+    uint32_t shadow_mask = 0;
+    for_each_ray(hit, [&](int i) {
+      glm::vec2 u = sampler.get_2d(pixel_ids[i], sample_index, dimension);
+      samples[i] = light.sample_li(recs[i], u);
+      if (!is_valid(samples[i])) return;
+      shadow_packet.rays[i] = make_shadow_ray(recs[i], samples[i]);
+      shadow_mask |= 1u << i;
+    });
+    uint32_t lit = shadow_mask & ~scene.is_occluded(shadow_packet, shadow_mask);
+    for_each_ray(lit, [&](int i) {
+      L[i] += direct_radiance(*bsdfs[i], recs[i], wo[i], samples[i]);
+    });
+  });
+
+  // Reflected and refracted rays are incoherent and go one at a time.
+  for_each_ray(hit, [&](int i) {
+    SamplingContext ctx{sampler, pixel_ids[i], sample_index, num_samples};
+    const Material &mat = *scene.get_material(recs[i].material_id);
+    L[i] += trace_specular(*bsdfs[i], mat, recs[i], wo[i], packet.rays[i], scene,
+                           initial_state, Color(1.0f), ctx);
+  });
 }
 
 Color WhittedIntegrator::trace_ray(Ray &ray, const Scene &scene, PathState state, const SamplingContext& ctx) const {
@@ -66,10 +205,7 @@ Color WhittedIntegrator::trace_ray(Ray &ray, const Scene &scene, PathState state
 
   HitRecord rec;
   if (!scene.intersect(ray, rec)) {
-    if (!scene.environment_light_) {
-      return scene.render_context_.background_color;
-    }
-    return scene.environment_light_->sample_le(ray);
+    return miss_radiance(ray, scene);
   }
 
   Color throughput = state.current_medium ? state.current_medium->transmittance(rec.t) : Color(1.0f);
@@ -85,9 +221,22 @@ Color WhittedIntegrator::trace_ray(Ray &ray, const Scene &scene, PathState state
   L += mat.get_ambient_reflectance() * scene.ambient_light_->radiance;
 
   // Direct Lights
-  L += shade_direct(bsdf, rec, woW, scene, ctx) * throughput;
+  int bounce = scene.render_context_.max_recursion_depth - state.depth;
+  L += shade_direct(bsdf, rec, woW, scene, bounce, ctx) * throughput;
 
   // Recursive Components
+  L += trace_specular(bsdf, mat, rec, woW, ray, scene, state, throughput, ctx);
+
+  return L;
+}
+
+Color WhittedIntegrator::trace_specular(const BSDF &bsdf, const Material &mat,
+                                        const HitRecord &rec, const Vec3 &woW,
+                                        const Ray &ray, const Scene &scene,
+                                        const PathState &state,
+                                        const Color &throughput,
+                                        const SamplingContext &ctx) const {
+  Color L{0.0f};
   bsdf.foreach_specular_sample(woW, [&](const BxDFSample& bs) {
     PathState next_state = state;
     next_state.depth--;
@@ -110,31 +259,17 @@ Color WhittedIntegrator::trace_ray(Ray &ray, const Scene &scene, PathState state
 }
 
 Color WhittedIntegrator::shade_direct(const BSDF &bsdf, const HitRecord &rec,
-                                      const Vec3 &woW, const Scene &scene, const SamplingContext& ctx) const {
+                                      const Vec3 &woW, const Scene &scene, int bounce,
+                                      const SamplingContext& ctx) const {
   Color L_direct(0.0f);
-  auto process_lights = [&](const auto& light_list) {
-    for (const auto& light : light_list) {
-      glm::vec2 u = ctx.sampler.get_2d(ctx.pixel_id, ctx.sample_index, 0);
-      LightSample ls = light->sample_li(rec, u);
-
-      if (ls.pdf <= 0.0f || glm::length(ls.L) == 0) continue;
-
-      Ray shadow_ray(rec.p + rec.normal * 0.0006f, ls.wi);
-      shadow_ray.t_max = ls.dist - 0.0006f;
-
-      if (scene.is_occluded(shadow_ray)) continue;
-      
-      Color f = bsdf.f(woW, ls.wi);
-      float cos_theta = std::max(0.0f, glm::dot(rec.normal, ls.wi));
-
-      L_direct += (f * ls.L * cos_theta) / ls.pdf;
-    }
-  };
-
-  process_lights(scene.point_lights_);
-  process_lights(scene.area_lights_);
-  process_lights(scene.spot_lights_);
-  process_lights(scene.directional_lights_);
+  for_each_light(scene, [&](const auto &light, int light_index) {
+    int dimension = light_dimension(scene, bounce, light_index);
+    glm::vec2 u = ctx.sampler.get_2d(ctx.pixel_id, ctx.sample_index, dimension);
+    LightSample ls = light.sample_li(rec, u);
+    if (!is_valid(ls)) return;
+    if (scene.is_occluded(make_shadow_ray(rec, ls))) return;
+    L_direct += direct_radiance(bsdf, rec, woW, ls);
+  });
 
   return L_direct;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/ray.h"
+#include "core/ray_packet.h"
 #include "integrator.h"
 #include "core/types.h"
 #include "core/sampler.h"
@@ -10,17 +11,29 @@ namespace hasmet {
 
 struct SamplingContext;
 struct PathState;
+class Material;
 
 class WhittedIntegrator : public Integrator {
  public:
-  WhittedIntegrator() = default;
+  // Without packets every camera and shadow ray is traced on its own.
+  explicit WhittedIntegrator(bool use_packets = true,
+                             const TileSettings& tiles = {})
+      : Integrator(tiles), use_packets_(use_packets) {}
 
-  virtual void render(const Scene& scene, Film& film,
-                      const Camera& camera) const override;
+  virtual void render_samples(const Scene& scene, Film& film,
+                              const Camera& camera, int first_sample,
+                              int num_samples) const override;
 
  private:
+  // Camera rays of neighbouring pixels; ray i belongs to pixel_ids[i].
+  // Writes the radiance of each ray to L.
+  void trace_packet(RayPacket& packet, const Scene& scene, Sampler& sampler, const int* pixel_ids, int sample_index, int num_samples, Color* L) const;
   Color trace_ray(Ray& ray, const Scene& scene, PathState state, const SamplingContext& ctx) const;
-  Color shade_direct(const BSDF& bsdf, const HitRecord& rec, const Vec3& woW, const Scene& scene, const SamplingContext& ctx) const;
+  Color trace_specular(const BSDF& bsdf, const Material& mat, const HitRecord& rec, const Vec3& woW, const Ray& ray, const Scene& scene, const PathState& state, const Color& throughput, const SamplingContext& ctx) const;
+  // `bounce` counts the specular bounces before rec and picks the sampler
+  // dimensions of its light samples.
+  Color shade_direct(const BSDF& bsdf, const HitRecord& rec, const Vec3& woW, const Scene& scene, int bounce, const SamplingContext& ctx) const;
   Sampler sampler_;
+  bool use_packets_ = true;
 };
 } // namespace hasmet
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "checkpoint.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "camera/camera.h"
+#include "core/hash.h"
+#include "core/logging.h"
+#include "core/options.h"
+#include "core/sampler.h"
+#include "film/film.h"
+#include "io/mapped_file.h"
+
+namespace hasmet {
+namespace {
+// Bump when the layout changes.
+constexpr uint32_t kCheckpointVersion = 2;
+constexpr char kCheckpointMagic[4] = {'H', 'M', 'C', 'K'};
+
+// Header flags.
+constexpr uint32_t kHasActiveMask = 1u << 0;
+constexpr uint32_t kHasHeatmap = 1u << 1;
+
+struct CheckpointHeader {
+  char magic[4];
+  uint32_t version;
+  // See checkpoint_key.
+  uint64_t key;
+  uint32_t width;
+  uint32_t height;
+  int32_t next_sample;
+  uint32_t flags;
+  // Guards against checkpoints of a build with another Color layout.
+  uint32_t color_size;
+  uint32_t pad;
+};
+
+template <typename V>
+void write_section(std::ofstream& out, const std::vector<V>& values) {
+  out.write(reinterpret_cast<const char*>(values.data()),
+            values.size() * sizeof(V));
+}
+
+template <typename V>
+bool read_section(std::ifstream& in, size_t count, std::vector<V>& out) {
+  out.resize(count);
+  in.read(reinterpret_cast<char*>(out.data()), count * sizeof(V));
+  return static_cast<bool>(in);
+}
+}  // namespace
+
+std::string checkpoint_path(const Film& film) {
+  return film.filename_ + ".checkpoint";
+}
+
+uint64_t checkpoint_key(const Options& options, int frame, int camera_index,
+                        const Camera& camera) {
+  Hasher hasher;
+  hasher.add(kCheckpointVersion);
+  hasher.add(Sampler::kLayoutVersion);
+  MappedFile scene_file;
+  if (scene_file.open(options.scene_file)) {
+    hasher.add(scene_file.size());
+    hasher.add(scene_file.data(), scene_file.size());
+  }
+  hasher.add(frame);
+  hasher.add(camera_index);
+  hasher.add(camera.num_samples_);
+  hasher.add_string(camera.renderer_);
+  for (const std::string& param : camera.renderer_params_) {
+    hasher.add_string(param);
+  }
+  hasher.add(options.wavefront);
+  hasher.add(options.ray_packets);
+  return hasher.finish();
+}
+
+bool write_checkpoint(const std::string& path, uint64_t key, const Film& film,
+                      int next_sample) {
+  CheckpointHeader header = {};
+  std::memcpy(header.magic, kCheckpointMagic, 4);
+  header.version = kCheckpointVersion;
+  header.key = key;
+  header.width = film.width_;
+  header.height = film.height_;
+  header.next_sample = next_sample;
+  header.flags = (film.active_.empty() ? 0u : kHasActiveMask) |
+                 (film.has_heatmap() ? kHasHeatmap : 0u);
+  header.color_size = sizeof(Color);
+
+  std::error_code ec;
+  std::string temp_path =
+      path + ".tmp" + std::to_string(std::random_device{}());
+  {
+    std::ofstream out(temp_path, std::ios::binary);
+    if (!out) {
+      LOG_WARN("Could not write checkpoint " << temp_path);
+      return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_section(out, film.sample_sums_);
+    write_section(out, film.luminance_sq_sums_);
+    write_section(out, film.sample_counts_);
+    if (header.flags & kHasActiveMask) write_section(out, film.active_);
+    if (header.flags & kHasHeatmap) write_section(out, film.heatmap_);
+    if (!out) {
+      LOG_WARN("Could not write checkpoint " << temp_path);
+      out.close();
+      std::filesystem::remove(temp_path, ec);
+      return false;
+    }
+  }
+  std::filesystem::rename(temp_path, path, ec);
+  if (ec) {
+    LOG_WARN("Could not write checkpoint " << path << ": " << ec.message());
+    std::filesystem::remove(temp_path, ec);
+    return false;
+  }
+  return true;
+}
+
+bool read_checkpoint(const std::string& path, uint64_t key, bool adaptive,
+                     Film& film, int& next_sample) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+
+  CheckpointHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || std::memcmp(header.magic, kCheckpointMagic, 4) != 0 ||
+      header.version != kCheckpointVersion ||
+      header.width != static_cast<uint32_t>(film.width_) ||
+      header.height != static_cast<uint32_t>(film.height_) ||
+      header.color_size != sizeof(Color) || header.next_sample < 0) {
+    LOG_WARN("Ignoring checkpoint " << path << " of another image or build");
+    return false;
+  }
+  if (header.key != key) {
+    LOG_WARN("Ignoring checkpoint " << path
+             << " of another scene, camera or renderer");
+    return false;
+  }
+
+  size_t count = static_cast<size_t>(film.width_) * film.height_;
+  std::vector<Color> sums;
+  std::vector<double> luminance_sq_sums;
+  std::vector<int> counts;
+  std::vector<uint8_t> active;
+  std::vector<float> heatmap;
+  if (!read_section(in, count, sums) ||
+      !read_section(in, count, luminance_sq_sums) ||
+      !read_section(in, count, counts) ||
+      ((header.flags & kHasActiveMask) && !read_section(in, count, active)) ||
+      ((header.flags & kHasHeatmap) && !read_section(in, count, heatmap))) {
+    LOG_WARN("Ignoring truncated checkpoint " << path);
+    return false;
+  }
+
+  film.sample_sums_ = std::move(sums);
+  film.luminance_sq_sums_ = std::move(luminance_sq_sums);
+  film.sample_counts_ = std::move(counts);
+  // Retired pixels stay retired only if this render retires pixels too.
+  if (adaptive) film.active_ = std::move(active);
+  // A heatmap is only carried on if this render keeps one too.
+  if (film.has_heatmap() && !heatmap.empty()) film.heatmap_ = std::move(heatmap);
+  next_sample = header.next_sample;
+  return true;
+}
+}  // namespace hasmet
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace hasmet {
+class Camera;
+class Film;
+struct Options;
+
+// Progressive render state written periodically so an interrupted render
+// can go on where it stopped: the film's radiance sums, squared luminance
+// sums, sample counts, adaptive sampling mask and heatmap, plus the first
+// sample index of the next pass. Sample indices run on across passes, so
+// that index is all the sampler state a resumed render needs.
+
+// "<image>.checkpoint" next to the film's image.
+std::string checkpoint_path(const Film& film);
+
+// Fingerprint of what the samples of a render depend on: the scene file,
+// the frame, the camera (by its index in the scene) and its renderer, and
+// the integrator and sampler layout. A checkpoint only resumes a render
+// with the same key. Files the scene refers to, e.g. PLY meshes, are not
+// hashed.
+uint64_t checkpoint_key(const Options& options, int frame, int camera_index,
+                        const Camera& camera);
+
+// Writes through a temporary file, so a crash while writing leaves the
+// previous checkpoint intact. Failures are logged and return false.
+bool write_checkpoint(const std::string& path, uint64_t key, const Film& film,
+                      int next_sample);
+// Restores the accumulation buffers of `film`, which must be enabled, and
+// the next sample index. The adaptive sampling mask is only restored for
+// an adaptive render; others sample every pixel again. Returns false if
+// there is no checkpoint or it was written for another key, image size or
+// build.
+bool read_checkpoint(const std::string& path, uint64_t key, bool adaptive,
+                     Film& film, int& next_sample);
+}  // namespace hasmet
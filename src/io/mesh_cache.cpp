@@ -0,0 +1,237 @@
+#include "mesh_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "core/hash.h"
+#include "core/logging.h"
+#include "io/mapped_file.h"
+
+namespace hasmet {
+namespace {
+// Bump when the entry layout or anything that affects a built mesh changes.
+constexpr uint32_t kMeshCacheVersion = 2;
+constexpr char kMeshCacheMagic[4] = {'H', 'M', 'C', 'E'};
+// Sections start on this boundary so SIMD structs are aligned in the map.
+constexpr size_t kSectionAlignment = 64;
+
+struct MeshCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  // Guards against entries written by a build with different layouts.
+  uint32_t node_size;
+  uint32_t wide_node_size;
+  uint32_t packet_size;
+  uint32_t pad;
+  uint64_t num_positions;
+  uint64_t num_normals;
+  uint64_t num_uvs;
+  uint64_t num_indices;
+  uint64_t num_nodes;
+  uint64_t num_wide_nodes;
+  uint64_t num_packets;
+  float area;
+  float sah_cost;
+  float bounds[6];
+  // The BLAS build config, which refit needs for its SAH cost.
+  uint32_t split_method;
+  uint32_t layout;
+  int32_t num_bins;
+  int32_t max_leaf_size;
+  float traversal_cost;
+  float intersection_cost;
+  float spatial_split_budget;
+  uint32_t pad2;
+};
+
+void add_config(Hasher& hasher, const BvhBuildConfig& config) {
+  hasher.add(kMeshCacheVersion);
+  hasher.add(static_cast<int>(config.split_method));
+  hasher.add(static_cast<int>(config.layout));
+  hasher.add(config.num_bins);
+  hasher.add(config.max_leaf_size);
+  hasher.add(config.traversal_cost);
+  hasher.add(config.intersection_cost);
+  hasher.add(config.spatial_split_budget);
+}
+
+size_t align_section(size_t offset) {
+  return (offset + kSectionAlignment - 1) / kSectionAlignment *
+         kSectionAlignment;
+}
+
+template <typename V>
+bool read_section(const MappedFile& file, size_t& offset, uint64_t count,
+                  std::vector<V>& out) {
+  offset = align_section(offset);
+  size_t bytes = static_cast<size_t>(count) * sizeof(V);
+  if (offset + bytes > file.size()) return false;
+  out.resize(static_cast<size_t>(count));
+  if (bytes) std::memcpy(out.data(), file.data() + offset, bytes);
+  offset += bytes;
+  return true;
+}
+
+template <typename V>
+void write_section(std::ofstream& out, const std::vector<V>& values) {
+  static const char kZeros[kSectionAlignment] = {};
+  size_t offset = static_cast<size_t>(out.tellp());
+  out.write(kZeros, align_section(offset) - offset);
+  out.write(reinterpret_cast<const char*>(values.data()),
+            values.size() * sizeof(V));
+}
+}  // namespace
+
+MeshCache::MeshCache(std::string directory)
+    : directory_(std::move(directory)) {}
+
+std::string MeshCache::entry_path(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.hmc",
+                static_cast<unsigned long long>(key));
+  return (std::filesystem::path(directory_) / name).string();
+}
+
+uint64_t MeshCache::file_key(const std::string& filename, bool smooth_shading,
+                             const BvhBuildConfig& config) const {
+  MappedFile file;
+  if (!file.open(filename)) return 0;
+  Hasher hasher;
+  add_config(hasher, config);
+  hasher.add(smooth_shading);
+  hasher.add(file.size());
+  hasher.add(file.data(), file.size());
+  return hasher.finish();
+}
+
+uint64_t MeshCache::data_key(const MeshData& data,
+                             const BvhBuildConfig& config) const {
+  Hasher hasher;
+  add_config(hasher, config);
+  hasher.add_vector(data.positions);
+  hasher.add_vector(data.normals);
+  hasher.add_vector(data.uvs);
+  hasher.add_vector(data.indices);
+  return hasher.finish();
+}
+
+std::shared_ptr<Mesh> MeshCache::load(uint64_t key) const {
+  if (key == 0) return nullptr;
+  MappedFile file;
+  if (!file.open(entry_path(key))) return nullptr;
+
+  MeshCacheHeader header;
+  if (file.size() < sizeof(header)) return nullptr;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, kMeshCacheMagic, 4) != 0 ||
+      header.version != kMeshCacheVersion || header.key != key ||
+      header.node_size != sizeof(LinearBvhNode) ||
+      header.wide_node_size != sizeof(WideBvhNode) ||
+      header.packet_size != sizeof(Triangle4) || header.num_nodes == 0) {
+    return nullptr;
+  }
+
+  std::shared_ptr<Mesh> mesh(new Mesh());
+  std::vector<LinearBvhNode> nodes;
+  std::vector<WideBvhNode> wide_nodes;
+  size_t offset = sizeof(header);
+  if (!read_section(file, offset, header.num_positions,
+                    mesh->data_.positions) ||
+      !read_section(file, offset, header.num_normals, mesh->data_.normals) ||
+      !read_section(file, offset, header.num_uvs, mesh->data_.uvs) ||
+      !read_section(file, offset, header.num_indices, mesh->data_.indices) ||
+      !read_section(file, offset, header.num_nodes, nodes) ||
+      !read_section(file, offset, header.num_wide_nodes, wide_nodes) ||
+      !read_section(file, offset, header.num_packets, mesh->packets_)) {
+    LOG_WARN("Ignoring truncated mesh cache entry " << entry_path(key));
+    return nullptr;
+  }
+
+  BvhBuildConfig config;
+  config.split_method = static_cast<BvhSplitMethod>(header.split_method);
+  config.layout = static_cast<BvhLayout>(header.layout);
+  config.num_bins = header.num_bins;
+  config.max_leaf_size = header.max_leaf_size;
+  config.traversal_cost = header.traversal_cost;
+  config.intersection_cost = header.intersection_cost;
+  config.spatial_split_budget = header.spatial_split_budget;
+  mesh->blas_.restore(std::move(nodes), std::move(wide_nodes), config,
+                      header.sah_cost);
+  mesh->area_ = header.area;
+  mesh->local_aabb_.x = Interval(header.bounds[0], header.bounds[1]);
+  mesh->local_aabb_.y = Interval(header.bounds[2], header.bounds[3]);
+  mesh->local_aabb_.z = Interval(header.bounds[4], header.bounds[5]);
+  return mesh;
+}
+
+void MeshCache::store(uint64_t key, const Mesh& mesh) const {
+  if (key == 0 || mesh.blas_.nodes().empty()) return;
+
+  MeshCacheHeader header = {};
+  std::memcpy(header.magic, kMeshCacheMagic, 4);
+  header.version = kMeshCacheVersion;
+  header.key = key;
+  header.node_size = sizeof(LinearBvhNode);
+  header.wide_node_size = sizeof(WideBvhNode);
+  header.packet_size = sizeof(Triangle4);
+  header.num_positions = mesh.data_.positions.size();
+  header.num_normals = mesh.data_.normals.size();
+  header.num_uvs = mesh.data_.uvs.size();
+  header.num_indices = mesh.data_.indices.size();
+  header.num_nodes = mesh.blas_.nodes().size();
+  header.num_wide_nodes = mesh.blas_.wide_nodes().size();
+  header.num_packets = mesh.packets_.size();
+  header.area = mesh.area_;
+  header.sah_cost = mesh.blas_.sah_cost();
+  const BvhBuildConfig& config = mesh.blas_.config();
+  header.split_method = static_cast<uint32_t>(config.split_method);
+  header.layout = static_cast<uint32_t>(config.layout);
+  header.num_bins = config.num_bins;
+  header.max_leaf_size = config.max_leaf_size;
+  header.traversal_cost = config.traversal_cost;
+  header.intersection_cost = config.intersection_cost;
+  header.spatial_split_budget = config.spatial_split_budget;
+  for (int a = 0; a < 3; ++a) {
+    header.bounds[2 * a] = mesh.local_aabb_[a].min;
+    header.bounds[2 * a + 1] = mesh.local_aabb_[a].max;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(directory_, ec);
+  std::string path = entry_path(key);
+  std::string temp_path =
+      path + ".tmp" + std::to_string(std::random_device{}());
+  {
+    std::ofstream out(temp_path, std::ios::binary);
+    if (!out) {
+      LOG_WARN("Could not write mesh cache entry " << temp_path);
+      return;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_section(out, mesh.data_.positions);
+    write_section(out, mesh.data_.normals);
+    write_section(out, mesh.data_.uvs);
+    write_section(out, mesh.data_.indices);
+    write_section(out, mesh.blas_.nodes());
+    write_section(out, mesh.blas_.wide_nodes());
+    write_section(out, mesh.packets_);
+    if (!out) {
+      LOG_WARN("Could not write mesh cache entry " << temp_path);
+      out.close();
+      std::filesystem::remove(temp_path, ec);
+      return;
+    }
+  }
+  std::filesystem::rename(temp_path, path, ec);
+  if (ec) {
+    LOG_WARN("Could not write mesh cache entry " << path << ": "
+             << ec.message());
+    std::filesystem::remove(temp_path, ec);
+  }
+}
+}  // namespace hasmet
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "accelerator/bvh.h"
+#include "geometry/mesh.h"
+
+namespace hasmet {
+// On-disk cache of built meshes: vertex data, flattened BLAS nodes and
+// triangle packets in leaf order. Entries are keyed by a hash of the mesh
+// source and the BVH build settings, and are memory-mapped on load, so a hit
+// skips both parsing and building. Key 0 means "no key".
+class MeshCache {
+ public:
+  explicit MeshCache(std::string directory);
+
+  // Key of a mesh read from `filename`, hashing the raw file so the file
+  // need not be parsed. Returns 0 if the file cannot be read. Only valid
+  // for scenes without texture coordinates of their own, which the mesh
+  // would read its UVs from; use data_key there.
+  uint64_t file_key(const std::string& filename, bool smooth_shading,
+                    const BvhBuildConfig& config) const;
+  // Key of a mesh given inline in the scene file.
+  uint64_t data_key(const MeshData& data, const BvhBuildConfig& config) const;
+
+  // Returns nullptr on a miss or if the entry is stale or damaged.
+  std::shared_ptr<Mesh> load(uint64_t key) const;
+  // Writes through a temporary file, so concurrent renders never see a
+  // partial entry. Failures are logged and otherwise ignored.
+  void store(uint64_t key, const Mesh& mesh) const;
+
+ private:
+  std::string directory_;
+
+  std::string entry_path(uint64_t key) const;
+};
+}  // namespace hasmet
@@ -2,6 +2,8 @@
 #include <memory>
 #include <chrono>
 
+#include <omp.h>
+
 #include "camera/pinhole.h"
 #include "camera/thinlens.h"
 #include "core/logging.h"
@@ -14,18 +16,261 @@
 #include "scene/scene.h"
 #include "parser/parser.h"
 #include "core/timer.h"
+#include "core/options.h"
+#include "core/stats.h"
 #include "film/tonemap.h"
 #include "integrator/pathtracer.h"
+#include "integrator/progressive.h"
+#include "io/checkpoint.h"
+#include "integrator/wavefront.h"
 
 using namespace hasmet;
 
+namespace {
+void print_usage() {
+  LOG_ERROR("Usage: raytracer <input_json_file> [options]\n"
+            "  --bvh <median|sah|sbvh>\n"
+            "                       BVH split method (overrides scene)\n"
+            "  --bvh-bins <n>       Number of SAH bins (overrides scene)\n"
+            "  --bvh-layout <binary|wide4>\n"
+            "                       BVH node layout (overrides scene)\n"
+            "  --bvh-split-budget <f>\n"
+            "                       Extra SBVH references as a fraction of\n"
+            "                       the triangle count (overrides scene)\n"
+            "  --mesh-cache <dir>   Reuse parsed meshes and built BLASes\n"
+            "                       stored in <dir>\n"
+            "  --frames <first>[:<last>]\n"
+            "                       Animation frames to render (overrides\n"
+            "                       scene)\n"
+            "  --stats              Log BVH statistics, and traversal\n"
+            "                       counters in HASMET_STATS builds\n"
+            "  --heatmap            Write <image>_heatmap.png with the\n"
+            "                       traversal cost of each pixel\n"
+            "                       (HASMET_STATS builds only)\n"
+            "  --no-packets         Trace Whitted camera and shadow rays one\n"
+            "                       at a time\n"
+            "  --wavefront          Path trace in waves of paths advanced one\n"
+            "                       bounce at a time\n"
+            "  --threads <n>        Number of render threads\n"
+            "  --tile-size <n>      Edge length of render tiles in pixels\n"
+            "                       (default 16)\n"
+            "  --tile-order <hilbert|morton|scanline>\n"
+            "                       Order tiles are rendered in (default\n"
+            "                       hilbert)\n"
+            "  --progressive <n>    Render in passes of n samples per pixel;\n"
+            "                       Ctrl-C stops after the current pass and\n"
+            "                       writes the image so far\n"
+            "  --preview-interval <seconds>\n"
+            "                       With --progressive, rewrite the images\n"
+            "                       this often while rendering (default 10)\n"
+            "  --adaptive <error>   Stop sampling pixels once the standard\n"
+            "                       error of their mean is below this\n"
+            "                       fraction of it, e.g. 0.02\n"
+            "  --min-spp <n>        With --adaptive, samples every pixel\n"
+            "                       takes (default 16)\n"
+            "  --max-spp <n>        With --adaptive or --time-budget, most\n"
+            "                       samples a pixel takes (default: no\n"
+            "                       limit)\n"
+            "  --spp-aov            Write <image>_spp.png with the sample\n"
+            "                       count of each pixel\n"
+            "  --time-budget <seconds>\n"
+            "                       Add passes to each image until this much\n"
+            "                       time has passed instead of rendering the\n"
+            "                       camera's sample count\n"
+            "  --checkpoint-interval <seconds>\n"
+            "                       Save the render state to\n"
+            "                       <image>.checkpoint this often and when\n"
+            "                       the render ends\n"
+            "  --resume             Continue each image from its checkpoint");
+}
+
+// "out.png" -> "out_0007.png" for frame 7.
+std::string frame_image_name(const std::string& name, int frame) {
+  char suffix[16];
+  std::snprintf(suffix, sizeof(suffix), "_%04d", frame);
+  size_t dot = name.find_last_of('.');
+  size_t slash = name.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return name + suffix;
+  }
+  return name.substr(0, dot) + suffix + name.substr(dot);
+}
+
+// Writes the film as its own format and every tonemap of the camera.
+void write_images(const Camera& camera, const Film& film) {
+  if (film.get_extension() == "ext") {
+    film.write();
+  } else {
+    Tonemap tm;
+    tm.type = Tonemap::Type::LDR_LEGACY;
+    tm.extension = "." + film.get_extension();
+    Film tonemapped = do_tonemapping(tm, film);
+    tonemapped.write();
+  }
+
+  for (const Tonemap& tm : camera.tonemaps_) {
+      Film tonemapped = do_tonemapping(tm, film);
+      tonemapped.write();
+  }
+}
+
+void render_cameras(const Scene& scene, const Options& options, int frame,
+                    bool animated) {
+  for (size_t camera_index = 0; camera_index < scene.cameras_.size();
+       ++camera_index) {
+    const std::unique_ptr<Camera>& camera = scene.cameras_[camera_index];
+    if (progressive_render_stopped()) return;
+    std::string image_name = animated
+                                 ? frame_image_name(camera->image_name_, frame)
+                                 : camera->image_name_;
+    Film film(camera->film_width_, camera->film_height_, image_name);
+    if (options.heatmap) film.enable_heatmap();
+    std::unique_ptr<Integrator> integrator;
+    TileSettings tiles{options.tile_size, options.tile_order};
+    if (options.time_budget > 0.0f) {
+      tiles.deadline = std::chrono::steady_clock::now() +
+                       std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                           std::chrono::duration<float>(options.time_budget));
+    }
+    if (camera->renderer_ == "PathTracing") {
+      auto pt = options.wavefront
+                    ? std::make_unique<WavefrontPathTracerIntegrator>(tiles)
+                    : std::make_unique<PathTracerIntegrator>(tiles);
+      pt->configure(camera->renderer_params_);
+      integrator = std::move(pt);
+    } else {
+      integrator = std::make_unique<WhittedIntegrator>(options.ray_packets, tiles);
+    }
+    bool progressive = options.samples_per_pass > 0;
+    bool checkpoints = options.checkpoint_interval > 0.0f || options.resume;
+    if (progressive || checkpoints || options.adaptive_threshold > 0.0f ||
+        options.time_budget > 0.0f) {
+      ProgressiveSettings settings;
+      settings.deadline = tiles.deadline;
+      if (checkpoints) {
+        settings.checkpoint_path = checkpoint_path(film);
+        settings.checkpoint_key = checkpoint_key(
+            options, frame, static_cast<int>(camera_index), *camera);
+        settings.checkpoint_interval = options.checkpoint_interval;
+        settings.resume = options.resume;
+      }
+      if (progressive) {
+        settings.samples_per_pass = options.samples_per_pass;
+        settings.preview_interval = options.preview_interval;
+      }
+      settings.adaptive_threshold = options.adaptive_threshold;
+      if (options.min_spp > 0) settings.min_samples = options.min_spp;
+      if (options.max_spp > 0) settings.max_samples = options.max_spp;
+      render_progressive(*integrator, scene, film, *camera, settings,
+                         [&](const Film& preview) { write_images(*camera, preview); });
+    } else {
+      integrator->render(scene, film, *camera);
+    }
+    // Collect even when not logging so counters do not carry over.
+    TraversalReport traversal = collect_traversal_stats();
+    if (options.stats && kTraversalStats) log_traversal_stats(traversal);
+    film.write_heatmap();
+    if (options.sample_count_aov) film.write_sample_counts();
+    write_images(*camera, film);
+  }
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--bvh" && has_value) {
+      options.bvh_builder = argv[++i];
+    } else if (arg == "--bvh-bins" && has_value) {
+      options.bvh_bin_count = std::atoi(argv[++i]);
+    } else if (arg == "--bvh-layout" && has_value) {
+      options.bvh_layout = argv[++i];
+    } else if (arg == "--bvh-split-budget" && has_value) {
+      options.bvh_split_budget = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "--mesh-cache" && has_value) {
+      options.mesh_cache_dir = argv[++i];
+    } else if (arg == "--frames" && has_value) {
+      std::string range = argv[++i];
+      size_t colon = range.find(':');
+      options.first_frame = std::atoi(range.c_str());
+      options.last_frame = colon == std::string::npos
+                               ? options.first_frame
+                               : std::atoi(range.c_str() + colon + 1);
+    } else if (arg == "--stats") {
+      options.stats = true;
+    } else if (arg == "--heatmap") {
+      options.heatmap = true;
+    } else if (arg == "--no-packets") {
+      options.ray_packets = false;
+    } else if (arg == "--wavefront") {
+      options.wavefront = true;
+    } else if (arg == "--threads" && has_value) {
+      options.num_threads = std::atoi(argv[++i]);
+    } else if (arg == "--tile-size" && has_value) {
+      options.tile_size = std::atoi(argv[++i]);
+    } else if (arg == "--tile-order" && has_value) {
+      // Checked here so a typo fails before the scene is loaded.
+      try {
+        options.tile_order = parse_tile_order(argv[++i]);
+      } catch (const std::exception& e) {
+        LOG_ERROR(e.what());
+        return false;
+      }
+    } else if (arg == "--progressive" && has_value) {
+      options.samples_per_pass = std::atoi(argv[++i]);
+    } else if (arg == "--preview-interval" && has_value) {
+      options.preview_interval = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "--adaptive" && has_value) {
+      options.adaptive_threshold = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "--min-spp" && has_value) {
+      options.min_spp = std::atoi(argv[++i]);
+    } else if (arg == "--max-spp" && has_value) {
+      options.max_spp = std::atoi(argv[++i]);
+    } else if (arg == "--time-budget" && has_value) {
+      options.time_budget = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "--checkpoint-interval" && has_value) {
+      options.checkpoint_interval = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "--resume") {
+      options.resume = true;
+    } else if (arg == "--spp-aov") {
+      options.sample_count_aov = true;
+    } else if (arg.rfind("--", 0) != 0 && options.scene_file.empty()) {
+      options.scene_file = arg;
+    } else {
+      return false;
+    }
+  }
+  return !options.scene_file.empty();
+}
+}  // namespace
+
 int main(int argc, char* argv[]) {
-  if (argc != 2) {
-    LOG_ERROR("Usage: raytracer <input_json_file>");
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage();
     return 1;
   }
 
-  std::filesystem::path scene_path(argv[1]);
+  // Also caps the threads building BVHs.
+  if (options.num_threads > 0) omp_set_num_threads(options.num_threads);
+
+  if constexpr (!kTraversalStats) {
+    if (options.heatmap) {
+      LOG_WARN("--heatmap needs a build configured with -DHASMET_STATS=ON; ignoring it");
+      options.heatmap = false;
+    }
+    if (options.stats) {
+      LOG_WARN("Traversal counters need a build configured with -DHASMET_STATS=ON");
+    }
+  }
+
+  if (options.samples_per_pass > 0 || options.adaptive_threshold > 0.0f ||
+      options.time_budget > 0.0f || options.checkpoint_interval > 0.0f ||
+      options.resume) {
+    install_progressive_stop_handler();
+  }
+
+  std::filesystem::path scene_path(options.scene_file);
   if (!std::filesystem::exists(scene_path)) {
     LOG_ERROR("Input file does not exist: " << scene_path);
     return 1;
@@ -33,32 +278,23 @@ int main(int argc, char* argv[]) {
 
   try {
     LOG_INFO("Reading scene...");
-    Scene scene = Parser::ParserAdapter::read_scene(scene_path.string());
-    for (const std::unique_ptr<Camera>& camera : scene.cameras_) {
-      Film film(camera->film_width_, camera->film_height_, camera->image_name_);
-      std::unique_ptr<Integrator> integrator;
-      if (camera->renderer_ == "PathTracing") {
-        auto pt = std::make_unique<PathTracerIntegrator>();
-        pt->configure(camera->renderer_params_);
-        integrator = std::move(pt);
-      } else {
-        integrator = std::make_unique<WhittedIntegrator>();
-      }
-      integrator->render(scene, film, *camera);
-      if (film.get_extension() == "ext") {
-        film.write();
-      } else {
-        Tonemap tm;
-        tm.type = Tonemap::Type::LDR_LEGACY;
-        tm.extension = "." + film.get_extension();
-        Film tonemapped = do_tonemapping(tm, film);
-        tonemapped.write();
-      }
+    Scene scene = Parser::ParserAdapter::read_scene(scene_path.string(), options);
+    Animation& animation = scene.animation_;
+    if (options.last_frame >= options.first_frame) {
+      animation.first_frame = options.first_frame;
+      animation.last_frame = options.last_frame;
+    }
 
-      for (const Tonemap& tm : camera->tonemaps_) {
-          Film tonemapped = do_tonemapping(tm, film);
-          tonemapped.write();
-      }
+    if (animation.empty()) {
+      render_cameras(scene, options, 0, false);
+      return 0;
+    }
+    for (int frame = animation.first_frame;
+         frame <= animation.last_frame && !progressive_render_stopped();
+         ++frame) {
+      LOG_INFO("Frame " << frame);
+      animation.set_frame(scene, frame);
+      render_cameras(scene, options, frame, true);
     }
   } catch (const std::exception& e) {
     LOG_ERROR("An error occurred: " << e.what());
@@ -478,8 +478,15 @@ namespace hasmet
         file.close();
       }
     }
+
+    void loadPlyFile(Mesh_ &mesh, Scene_ &scene)
+    {
+      PlyHelpers::parsePlyFile(mesh.ply_file, mesh, scene);
+    }
+
     // Function implementation
-    void parseScene(const std::string &filename, Scene_ &scene)
+    void parseScene(const std::string &filename, Scene_ &scene,
+                    bool load_ply_files)
     {
       std::ifstream file(filename);
       if (!file.is_open())
@@ -517,6 +524,34 @@ namespace hasmet
       else
         scene.max_recursion_depth = 6;
 
+      if (scene_json.contains("BVHBuilder"))
+        scene.bvh_builder = scene_json["BVHBuilder"].get<std::string>();
+      else
+        scene.bvh_builder = "SAH";
+
+      if (scene_json.contains("BVHLayout"))
+        scene.bvh_layout = scene_json["BVHLayout"].get<std::string>();
+      else
+        scene.bvh_layout = "Wide4";
+
+      if (scene_json.contains("BVHBinCount"))
+        scene.bvh_bin_count =
+            std::stoi(scene_json["BVHBinCount"].get<std::string>());
+      else
+        scene.bvh_bin_count = 16;
+
+      if (scene_json.contains("BVHMaxLeafSize"))
+        scene.bvh_max_leaf_size =
+            std::stoi(scene_json["BVHMaxLeafSize"].get<std::string>());
+      else
+        scene.bvh_max_leaf_size = 4;
+
+      if (scene_json.contains("BVHSplitBudget"))
+        scene.bvh_split_budget =
+            std::stof(scene_json["BVHSplitBudget"].get<std::string>());
+      else
+        scene.bvh_split_budget = 0.3f;
+
       // --- Transformations ---
       scene.transformations.clear();
       if (scene_json.contains("Transformations"))
@@ -1207,7 +1242,9 @@ namespace hasmet
           {
             std::string ply = fj["_plyFile"];
             std::string dir = filename.substr(0, filename.find_last_of("/\\") + 1);
-            PlyHelpers::parsePlyFile(dir + ply, m, scene);
+            m.ply_file = dir + ply;
+            if (load_ply_files)
+              loadPlyFile(m, scene);
           }
           scene.meshes.push_back(m);
         };
@@ -1428,7 +1465,9 @@ namespace hasmet
               else if (fj.contains("_plyFile")) {
                   std::string ply = fj["_plyFile"];
                   std::string dir = filename.substr(0, filename.find_last_of("/\\") + 1);
-                  PlyHelpers::parsePlyFile(dir + ply, m, scene);
+                  m.ply_file = dir + ply;
+                  if (load_ply_files)
+                      loadPlyFile(m, scene);
               }
 
               scene.meshes.push_back(m);
@@ -1440,6 +1479,71 @@ namespace hasmet
           else
               parse_light_mesh(mj);
       }
+
+      // Animation
+      if (scene_json.contains("Animation"))
+      {
+        const auto &aj = scene_json["Animation"];
+        Animation_ &animation = scene.animation;
+        if (aj.contains("FrameRange"))
+        {
+          std::stringstream ss(aj["FrameRange"].get<std::string>());
+          ss >> animation.first_frame >> animation.last_frame;
+        }
+
+        auto parse_track = [&](const json &j)
+        {
+          AnimationTrack_ track;
+          track.target = j["_type"].get<std::string>();
+          track.id = std::stoi(j["_id"].get<std::string>());
+          auto parse_keyframe = [&](const json &kj)
+          {
+            Keyframe_ key;
+            key.frame = std::stoi(kj["_frame"].get<std::string>());
+            if (kj.contains("Transformations"))
+              parse_transform_refs(kj["Transformations"].get<std::string>(),
+                                   key.transformations);
+            track.keyframes.push_back(key);
+          };
+          const auto &kj = j["Keyframe"];
+          if (kj.is_array())
+            for (const auto &i : kj)
+              parse_keyframe(i);
+          else
+            parse_keyframe(kj);
+          std::sort(track.keyframes.begin(), track.keyframes.end(),
+                    [](const Keyframe_ &a, const Keyframe_ &b)
+                    { return a.frame < b.frame; });
+          animation.tracks.push_back(track);
+        };
+        if (aj.contains("Track"))
+        {
+          const auto &tj = aj["Track"];
+          if (tj.is_array())
+            for (const auto &i : tj)
+              parse_track(i);
+          else
+            parse_track(tj);
+        }
+
+        auto parse_sequence = [&](const json &j)
+        {
+          MeshSequence_ sequence;
+          sequence.mesh_id = std::stoi(j["_id"].get<std::string>());
+          std::string dir = filename.substr(0, filename.find_last_of("/\\") + 1);
+          sequence.ply_pattern = dir + j["_plyFile"].get<std::string>();
+          animation.mesh_sequences.push_back(sequence);
+        };
+        if (aj.contains("MeshSequence"))
+        {
+          const auto &sj = aj["MeshSequence"];
+          if (sj.is_array())
+            for (const auto &i : sj)
+              parse_sequence(i);
+          else
+            parse_sequence(sj);
+        }
+      }
     }
 
     void printSceneSummary(const Scene_ &scene)
@@ -1454,6 +1558,8 @@ namespace hasmet
       std::cout << "  Shadow Ray Epsilon    : " << scene.shadow_ray_epsilon << std::endl;
       std::cout << "  Intersect Test Eps.   : " << scene.intersection_test_epsilon << std::endl;
       std::cout << "  Max Recursion Depth   : " << scene.max_recursion_depth << std::endl;
+      std::cout << "  BVH Builder           : " << scene.bvh_builder << std::endl;
+      std::cout << "  BVH Layout            : " << scene.bvh_layout << std::endl;
       std::cout << std::endl;
 
       // 2. Cameras
@@ -166,6 +166,8 @@ typedef struct Mesh_ {
     int material_id;
     bool smooth_shading;
     std::vector<Triangle_> faces;
+    // Source PLY file, if any. `faces` stays empty until it is loaded.
+    std::string ply_file;
     std::vector<Transformation_> transformations;
     Vec3f_ motion_blur;
     std::vector<int> texture_ids;
@@ -203,10 +205,43 @@ typedef struct Plane_ {
     std::vector<int> texture_ids;
 } Plane_;
 
+typedef struct Keyframe_ {
+    int frame;
+    std::vector<Transformation_> transformations;
+} Keyframe_;
+
+// Keyframed transformations of one object: target is "Camera", "Mesh",
+// "MeshInstance" or "Sphere". They replace the object's own
+// transformations while animating.
+typedef struct AnimationTrack_ {
+    std::string target;
+    int id;
+    std::vector<Keyframe_> keyframes;
+} AnimationTrack_;
+
+// Per-frame vertex data of a mesh; ply_pattern is a printf pattern taking
+// the frame number, e.g. "wave_%04d.ply", resolved like _plyFile.
+typedef struct MeshSequence_ {
+    int mesh_id;
+    std::string ply_pattern;
+} MeshSequence_;
+
+typedef struct Animation_ {
+    int first_frame = 0;
+    int last_frame = -1;
+    std::vector<AnimationTrack_> tracks;
+    std::vector<MeshSequence_> mesh_sequences;
+} Animation_;
+
 typedef struct Scene_ {
     float shadow_ray_epsilon;
     float intersection_test_epsilon;
     int max_recursion_depth;
+    std::string bvh_builder;
+    std::string bvh_layout;
+    int bvh_bin_count;
+    int bvh_max_leaf_size;
+    float bvh_split_budget;
     Vec3f_ background_color;
     Vec3f_ ambient_light;
     std::vector<Camera_> cameras;
@@ -227,10 +262,16 @@ typedef struct Scene_ {
     std::vector<Plane_> planes;
     std::vector<Transformation_> transformations;
     std::vector<BRDF_> brdfs;
+    Animation_ animation;
 } Scene_;
 
 // --- Function Declaration ---
-void parseScene(const std::string& filename, Scene_& scene);
+// With load_ply_files false, meshes only record their PLY path and
+// loadPlyFile must be called for the ones that are needed.
+void parseScene(const std::string& filename, Scene_& scene,
+                bool load_ply_files = true);
+// Appends the vertices of mesh.ply_file to the scene and fills mesh.faces.
+void loadPlyFile(Mesh_& mesh, Scene_& scene);
 
 inline std::ostream& operator<<(std::ostream& os, const Vec3f_& v) {
     os << "(" << v.x << ", " << v.y << ", " << v.z << ")";
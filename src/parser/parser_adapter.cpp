@@ -1,4 +1,5 @@
 #include <cctype>
+#include <climits>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
@@ -21,6 +22,9 @@
 #include "core/types.h"
 #include "accelerator/instance.h"
 #include "core/logging.h"
+#include "core/options.h"
+#include "core/timer.h"
+#include "io/mesh_cache.h"
 #include "texture/texture.h"
 #include "texture/texture_manager.h"
 #include "image/image_manager.h"
@@ -303,16 +307,312 @@ namespace hasmet
                               camera_.aperture_size, camera_.focus_distance);
       }
 
-      Scene read_scene(std::string filename)
+      MeshData create_mesh_data(const Parser::Mesh_ &mesh_,
+                                const Parser::Scene_ &parsed_scene)
       {
+        MeshData data;
+        // Vertex ids index the scene-wide vertex list; only copy the vertices
+        // this mesh references and renumber them from zero.
+        int min_id = INT_MAX;
+        int max_id = -1;
+        for (const Triangle_ &triangle_ : mesh_.faces)
+        {
+          min_id = std::min({min_id, triangle_.v0_id, triangle_.v1_id, triangle_.v2_id});
+          max_id = std::max({max_id, triangle_.v0_id, triangle_.v1_id, triangle_.v2_id});
+        }
+        int range = std::max(0, max_id - min_id + 1);
+        std::vector<int> local_ids(range, -1);
+        bool has_uv = !parsed_scene.tex_coord_data.empty();
+
+        data.indices.reserve(mesh_.faces.size() * 3);
+        for (const Triangle_ &triangle_ : mesh_.faces)
+        {
+          for (int id : {triangle_.v0_id, triangle_.v1_id, triangle_.v2_id})
+          {
+            int &local_id = local_ids[id - min_id];
+            if (local_id < 0)
+            {
+              local_id = static_cast<int>(data.positions.size());
+              data.positions.push_back(create_vec3(parsed_scene.vertex_data[id]));
+              if (has_uv)
+                data.uvs.push_back(create_vec2(parsed_scene.tex_coord_data[id]));
+            }
+            data.indices.push_back(static_cast<uint32_t>(local_id));
+          }
+        }
+
+        if (mesh_.smooth_shading)
+        {
+          // Area weighted average of the adjacent face normals; normalized
+          // after interpolation.
+          std::vector<Vec3> normal_sums(data.positions.size(), Vec3(0.0f));
+          std::vector<float> area_sums(data.positions.size(), 0.0f);
+          for (size_t f = 0; f < data.num_faces(); ++f)
+          {
+            const uint32_t *idx = &data.indices[3 * f];
+            Vec3 v0 = data.positions[idx[0]];
+            Vec3 v1 = data.positions[idx[1]];
+            Vec3 v2 = data.positions[idx[2]];
+            float area = get_triangle_area(v0, v1, v2);
+            Vec3 face_normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+            for (int k = 0; k < 3; ++k)
+            {
+              normal_sums[idx[k]] = normal_sums[idx[k]] + face_normal * area;
+              area_sums[idx[k]] += area;
+            }
+          }
+          data.normals.resize(data.positions.size());
+          for (size_t i = 0; i < data.normals.size(); ++i)
+          {
+            data.normals[i] = area_sums[i] > 0.0f ? normal_sums[i] / area_sums[i]
+                                                  : normal_sums[i];
+          }
+        }
+        return data;
+      }
+
+      BvhBuildConfig create_bvh_config(const Parser::Scene_ &scene_,
+                                       const Options &options)
+      {
+        BvhBuildConfig config;
+        std::string builder = options.bvh_builder.empty()
+                                  ? scene_.bvh_builder
+                                  : options.bvh_builder;
+        std::transform(builder.begin(), builder.end(), builder.begin(), ::tolower);
+        if (builder == "median")
+        {
+          config.split_method = BvhSplitMethod::Median;
+        }
+        else if (builder == "sah")
+        {
+          config.split_method = BvhSplitMethod::SAH;
+        }
+        else if (builder == "sbvh")
+        {
+          config.split_method = BvhSplitMethod::SBVH;
+        }
+        else
+        {
+          throw std::runtime_error("Unsupported BVH builder: " + builder);
+        }
+
+        std::string layout = options.bvh_layout.empty() ? scene_.bvh_layout
+                                                        : options.bvh_layout;
+        std::transform(layout.begin(), layout.end(), layout.begin(), ::tolower);
+        if (layout == "binary" || layout == "bvh2")
+        {
+          config.layout = BvhLayout::Binary;
+        }
+        else if (layout == "wide4" || layout == "bvh4")
+        {
+          config.layout = BvhLayout::Wide4;
+        }
+        else
+        {
+          throw std::runtime_error("Unsupported BVH layout: " + layout);
+        }
+
+        config.num_bins = options.bvh_bin_count > 0 ? options.bvh_bin_count
+                                                    : scene_.bvh_bin_count;
+        config.max_leaf_size = scene_.bvh_max_leaf_size;
+        config.spatial_split_budget = options.bvh_split_budget >= 0.0f
+                                          ? options.bvh_split_budget
+                                          : scene_.bvh_split_budget;
+        return config;
+      }
+
+      std::unique_ptr<Camera> create_camera(const Parser::Camera_ &camera_)
+      {
+        std::unique_ptr<Camera> camera_ptr;
+        if (camera_.aperture_size > 0)
+        {
+          camera_ptr = std::make_unique<ThinLensCamera>(create_thinlens_camera(camera_));
+        }
+        else
+        {
+          camera_ptr = std::make_unique<PinholeCamera>(create_pinhole_camera(camera_));
+        }
+        camera_ptr->renderer_ = camera_.renderer;
+        camera_ptr->renderer_params_ = camera_.renderer_params;
+        // Read tonemaps
+        camera_ptr->tonemaps_.reserve(camera_.tonemaps.size());
+        for (const Parser::Tonemap_& tm : camera_.tonemaps) {
+          hasmet::Tonemap t;
+          if (tm.tmo == "Photographic") {
+            t.type = hasmet::Tonemap::Type::PHOTOGRAPHIC;
+          } else if (tm.tmo == "Filmic") {
+            t.type = hasmet::Tonemap::Type::FILMIC;
+          } else if (tm.tmo == "ACES") {
+            t.type = hasmet::Tonemap::Type::ACES;
+          } else {
+            t.type = hasmet::Tonemap::Type::LDR_LEGACY;
+          }
+          t.options[0] = tm.tmo_options[0];
+          t.options[1] = tm.tmo_options[1];
+          t.saturation = tm.saturation;
+          t.gamma = tm.gamma;
+          t.extension = tm.extension;
+          camera_ptr->tonemaps_.push_back(t);
+        }
+
+        return camera_ptr;
+      }
+
+      // Where parsed objects ended up in Scene::objects_, by parsed id, so
+      // animation tracks can find them.
+      struct ObjectIndices
+      {
+        std::unordered_map<int, size_t> meshes;
+        std::unordered_map<int, size_t> mesh_instances;
+        std::unordered_map<int, size_t> spheres;
+        // Part of a mesh instance's transform inherited from its base mesh.
+        std::unordered_map<int, glm::mat4> instance_bases;
+      };
+
+      // Expands the first printf-style %d (optionally zero padded, e.g.
+      // %04d) in `pattern` with `frame`.
+      std::string format_frame(const std::string &pattern, int frame)
+      {
+        size_t percent = pattern.find('%');
+        if (percent == std::string::npos)
+          return pattern;
+        size_t end = percent + 1;
+        bool zero_pad = end < pattern.size() && pattern[end] == '0';
+        int width = 0;
+        while (end < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[end])))
+          width = width * 10 + (pattern[end++] - '0');
+        if (end >= pattern.size() || pattern[end] != 'd')
+          throw std::runtime_error("Unsupported frame pattern: " + pattern);
+
+        std::string number = std::to_string(frame);
+        if (static_cast<int>(number.size()) < width)
+          number.insert(0, width - number.size(), zero_pad ? '0' : ' ');
+        return pattern.substr(0, percent) + number + pattern.substr(end + 1);
+      }
+
+      std::vector<TransformKeyframe> create_keyframes(
+          const Parser::AnimationTrack_ &track_)
+      {
+        std::vector<TransformKeyframe> keys;
+        for (const Parser::Keyframe_ &key_ : track_.keyframes)
+          keys.push_back({key_.frame, create_transformation_matrix(key_.transformations)});
+        return keys;
+      }
+
+      Animation create_animation(const Parser::Scene_ &parsed_scene,
+                                 const Scene &scene,
+                                 const ObjectIndices &indices,
+                                 const std::vector<std::shared_ptr<Mesh>> &mesh_geos)
+      {
+        const Parser::Animation_ &animation_ = parsed_scene.animation;
+        Animation animation;
+        animation.first_frame = animation_.first_frame;
+        animation.last_frame = animation_.last_frame;
+
+        for (const Parser::AnimationTrack_ &track_ : animation_.tracks)
+        {
+          if (track_.target == "Camera")
+          {
+            size_t i = 0;
+            while (i < parsed_scene.cameras.size() && parsed_scene.cameras[i].id != track_.id)
+              ++i;
+            if (i == parsed_scene.cameras.size())
+            {
+              LOG_WARN("Animation track for unknown camera " << track_.id);
+              continue;
+            }
+            Parser::Camera_ camera_ = parsed_scene.cameras[i];
+            animation.camera_tracks.push_back(
+                {i, create_keyframes(track_),
+                 [camera_](const glm::mat4 &transform)
+                 {
+                   Parser::Camera_ posed = camera_;
+                   Parser::Transformation_ composite;
+                   composite.type = Parser::TransformationType::COMPOSITE;
+                   glm::mat4 rows = glm::transpose(transform);
+                   const float *values = glm::value_ptr(rows);
+                   composite.data.assign(values, values + 16);
+                   posed.transformations = {composite};
+                   return create_camera(posed);
+                 }});
+            continue;
+          }
+
+          const std::unordered_map<int, size_t> *objects = nullptr;
+          if (track_.target == "Mesh")
+            objects = &indices.meshes;
+          else if (track_.target == "MeshInstance")
+            objects = &indices.mesh_instances;
+          else if (track_.target == "Sphere")
+            objects = &indices.spheres;
+          auto it = objects ? objects->find(track_.id) : std::unordered_map<int, size_t>::const_iterator();
+          if (!objects || it == objects->end())
+          {
+            LOG_WARN("Animation track for unknown " << track_.target << " " << track_.id);
+            continue;
+          }
+          InstanceTrack track{it->second, glm::mat4(1.0f), create_keyframes(track_)};
+          if (track_.target == "MeshInstance")
+          {
+            auto base = indices.instance_bases.find(track_.id);
+            if (base != indices.instance_bases.end())
+              track.base = base->second;
+          }
+          animation.instance_tracks.push_back(std::move(track));
+        }
+
+        for (const Parser::MeshSequence_ &sequence_ : animation_.mesh_sequences)
+        {
+          size_t i = 0;
+          while (i < parsed_scene.meshes.size() && parsed_scene.meshes[i].id != sequence_.mesh_id)
+            ++i;
+          if (i == parsed_scene.meshes.size())
+          {
+            LOG_WARN("Mesh sequence for unknown mesh " << sequence_.mesh_id);
+            continue;
+          }
+          MeshSequence sequence;
+          sequence.mesh = mesh_geos[i];
+          for (size_t k = 0; k < scene.objects_.size(); ++k)
+          {
+            if (&scene.objects_[k].object() == sequence.mesh.get())
+              sequence.instances.push_back(k);
+          }
+          Parser::Mesh_ mesh_ = parsed_scene.meshes[i];
+          mesh_.faces.clear();
+          std::string pattern = sequence_.ply_pattern;
+          sequence.load = [mesh_, pattern](int frame)
+          {
+            // Each frame is parsed on its own so vertex ids start at zero.
+            Parser::Scene_ frame_scene;
+            Parser::Mesh_ frame_mesh = mesh_;
+            frame_mesh.ply_file = format_frame(pattern, frame);
+            Parser::loadPlyFile(frame_mesh, frame_scene);
+            if (frame_mesh.faces.empty())
+              throw std::runtime_error("No faces in mesh frame " + frame_mesh.ply_file);
+            return create_mesh_data(frame_mesh, frame_scene);
+          };
+          animation.mesh_sequences.push_back(std::move(sequence));
+        }
+        return animation;
+      }
+
+      Scene read_scene(std::string filename, const Options &options)
+      {
+        // With a mesh cache, PLY files are only parsed for cache misses.
+        std::unique_ptr<MeshCache> mesh_cache;
+        if (!options.mesh_cache_dir.empty())
+          mesh_cache = std::make_unique<MeshCache>(options.mesh_cache_dir);
+
         Parser::Scene_ parsed_scene;
-        Parser::parseScene(filename, parsed_scene);
+        Parser::parseScene(filename, parsed_scene, !mesh_cache);
 
         Scene scene;
         scene.render_context_ = RenderContext{
             create_color(parsed_scene.background_color),
             parsed_scene.shadow_ray_epsilon, parsed_scene.intersection_test_epsilon,
             parsed_scene.max_recursion_depth};
+        scene.bvh_config_ = create_bvh_config(parsed_scene, options);
         
         std::filesystem::path scene_path(filename);
         std::filesystem::path base_dir = scene_path.parent_path();
@@ -333,39 +633,7 @@ namespace hasmet
         // Read Cameras
         for (const Parser::Camera_ &camera_ : parsed_scene.cameras)
         {
-          std::unique_ptr<Camera> camera_ptr;
-          if (camera_.aperture_size > 0)
-          {
-            camera_ptr = std::make_unique<ThinLensCamera>(create_thinlens_camera(camera_));
-          }
-          else
-          {
-            camera_ptr = std::make_unique<PinholeCamera>(create_pinhole_camera(camera_));
-          }
-          camera_ptr->renderer_ = camera_.renderer;
-          camera_ptr->renderer_params_ = camera_.renderer_params;
-          // Read tonemaps
-          camera_ptr->tonemaps_.reserve(camera_.tonemaps.size());
-          for (const Parser::Tonemap_& tm : camera_.tonemaps) {
-            hasmet::Tonemap t;
-            if (tm.tmo == "Photographic") {
-              t.type = hasmet::Tonemap::Type::PHOTOGRAPHIC;
-            } else if (tm.tmo == "Filmic") {
-              t.type = hasmet::Tonemap::Type::FILMIC;
-            } else if (tm.tmo == "ACES") {
-              t.type = hasmet::Tonemap::Type::ACES;
-            } else {
-              t.type = hasmet::Tonemap::Type::LDR_LEGACY;
-            }
-            t.options[0] = tm.tmo_options[0];
-            t.options[1] = tm.tmo_options[1];
-            t.saturation = tm.saturation;
-            t.gamma = tm.gamma;
-            t.extension = tm.extension;
-            camera_ptr->tonemaps_.push_back(t);
-          }
-
-          scene.cameras_.push_back(std::move(camera_ptr));
+          scene.cameras_.push_back(create_camera(camera_));
         }
         std::vector<BRDFConfig> brdf_configs;
         for (const Parser::BRDF_ brdf : parsed_scene.brdfs) {
@@ -416,6 +684,7 @@ namespace hasmet
           scene.materials_[material_.id] = std::move(new_material);
         }
 
+        ObjectIndices object_indices;
         for (const Parser::Sphere_ &sphere_ : parsed_scene.spheres)
         {
           Vec3 position = create_vec3(parsed_scene.vertex_data[sphere_.center_vertex_id]);
@@ -426,6 +695,7 @@ namespace hasmet
           inst.set_material_id(sphere_.material_id);
           inst.set_texture_ids(sphere_.texture_ids);
           inst.radiance_ = create_vec3(sphere_.radiance);
+          object_indices.spheres[sphere_.id] = scene.objects_.size();
           scene.objects_.push_back(std::move(inst));
         }
 
@@ -479,137 +749,79 @@ namespace hasmet
         };
         std::unordered_map<int, ObjectBase> object_registry;
 
-        for (const Parser::Mesh_ &mesh_ : parsed_scene.meshes)
+        // Face setup and BLAS construction are independent per mesh, so build
+        // them concurrently; instances are created afterwards in file order.
+        const int num_meshes = static_cast<int>(parsed_scene.meshes.size());
+        std::vector<std::shared_ptr<Mesh>> mesh_geos(num_meshes);
         {
-          std::vector<Triangle> mesh_faces;
-          if (mesh_.smooth_shading)
+          SCOPED_TIMER("Mesh construction");
+          std::vector<uint64_t> cache_keys(num_meshes, 0);
+          if (mesh_cache)
           {
-            std::vector<std::vector<std::pair<Vec3, float>>>
-                per_vertex_triangles;
-            per_vertex_triangles.resize(parsed_scene.vertex_data.size());
-            for (const Triangle_ &triangle_ : mesh_.faces)
+            // Meshes take their UVs from the scene-wide texture coordinates
+            // by vertex id, so once the scene file supplies some, a PLY's
+            // bytes no longer determine its mesh; those go by data_key.
+            const bool scene_uvs = !parsed_scene.tex_coord_data.empty();
+#pragma omp parallel for schedule(dynamic, 1)
+            for (int i = 0; i < num_meshes; ++i)
             {
-              Vec3 v0 = create_vec3(parsed_scene.vertex_data[triangle_.v0_id]);
-              Vec3 v1 = create_vec3(parsed_scene.vertex_data[triangle_.v1_id]);
-              Vec3 v2 = create_vec3(parsed_scene.vertex_data[triangle_.v2_id]);
-              float area = get_triangle_area(v0, v1, v2);
-              Vec3 edge1 = v1 - v0;
-              Vec3 edge2 = v2 - v0;
-              Vec3 face_normal = glm::normalize(glm::cross(edge1, edge2));
-              per_vertex_triangles[triangle_.v0_id].push_back(
-                  std::make_pair(face_normal, area));
-              per_vertex_triangles[triangle_.v1_id].push_back(
-                  std::make_pair(face_normal, area));
-              per_vertex_triangles[triangle_.v2_id].push_back(
-                  std::make_pair(face_normal, area));
+              const Parser::Mesh_ &mesh_ = parsed_scene.meshes[i];
+              if (mesh_.ply_file.empty() || scene_uvs)
+                continue;
+              cache_keys[i] = mesh_cache->file_key(
+                  mesh_.ply_file, mesh_.smooth_shading, scene.bvh_config_);
+              mesh_geos[i] = mesh_cache->load(cache_keys[i]);
             }
-            std::vector<Vec3> vertex_normals;
-            for (const auto &v : per_vertex_triangles)
+            // Misses append to the shared vertex list, so parse serially.
+            for (int i = 0; i < num_meshes; ++i)
             {
-              Vec3 normal(0.0, 0.0, 0.0);
-              float total_area = 0.0;
-              for (const auto &pair : v)
-              {
-                normal = normal + pair.first * pair.second;
-                total_area += pair.second;
-              }
-              if (total_area > 0.0)
-              {
-                normal = normal / total_area;
-              }
-              vertex_normals.push_back(normal);
-            }
-            for (const Triangle_ &triangle_ : mesh_.faces)
-            {
-              // 1. Vertices
-              Vec3 vertices[3] = {
-                  create_vec3(parsed_scene.vertex_data[triangle_.v0_id]),
-                  create_vec3(parsed_scene.vertex_data[triangle_.v1_id]),
-                  create_vec3(parsed_scene.vertex_data[triangle_.v2_id])};
-
-              // 2. Normals
-              Vec3 per_vertex_normals[3] = {
-                  vertex_normals[triangle_.v0_id],
-                  vertex_normals[triangle_.v1_id],
-                  vertex_normals[triangle_.v2_id]};
-
-              // 3. Texture Coordinates
-              Vec2 uvs[3];
-              bool has_uv = !parsed_scene.tex_coord_data.empty();
-              if (has_uv)
-              {
-                uvs[0] = create_vec2(parsed_scene.tex_coord_data[triangle_.v0_id]);
-                uvs[1] = create_vec2(parsed_scene.tex_coord_data[triangle_.v1_id]);
-                uvs[2] = create_vec2(parsed_scene.tex_coord_data[triangle_.v2_id]);
-              }
-
-              // 4. Tangent & Bitangent
-              Vec3 tangents[2];
-              if (has_uv) {
-                Vec3 edge1 = vertices[1] - vertices[0];
-                Vec3 edge2 = vertices[2] - vertices[0];
-                auto a = uvs[1].x - uvs[0].x;
-                auto b = uvs[1].y - uvs[0].y;
-                auto c = uvs[2].x - uvs[0].x;
-                auto d = uvs[2].y - uvs[0].y;
-                float inv_det = 1.0f / (a * d - b * c);
-
-                tangents[0] = inv_det * (d * edge1 - b * edge2);
-                tangents[1] = inv_det * (-c * edge1 + a * edge2);
-                tangents[0] = glm::normalize(tangents[0]);
-                tangents[1] = glm::normalize(tangents[1]);
-              }
-
-              mesh_faces.push_back(Triangle(vertices, per_vertex_normals, has_uv ? uvs : nullptr, has_uv ? tangents : nullptr, true));
+              Parser::Mesh_ &mesh_ = parsed_scene.meshes[i];
+              if (!mesh_geos[i] && !mesh_.ply_file.empty())
+                Parser::loadPlyFile(mesh_, parsed_scene);
             }
           }
-          else
+
+#pragma omp parallel for schedule(dynamic, 1)
+          for (int i = 0; i < num_meshes; ++i)
           {
-            for (const Parser::Triangle_ &triangle_ : mesh_.faces)
+            if (mesh_geos[i])
+              continue;
+            MeshData data = create_mesh_data(parsed_scene.meshes[i], parsed_scene);
+            if (mesh_cache && cache_keys[i] == 0)
             {
-                // 1. Vertices
-                Vec3 vertices[3] = {
-                  create_vec3(parsed_scene.vertex_data[triangle_.v0_id]),
-                  create_vec3(parsed_scene.vertex_data[triangle_.v1_id]),
-                  create_vec3(parsed_scene.vertex_data[triangle_.v2_id])};
-                
-                // 2. Texture Coordinates
-                Vec2 uvs[3];
-                bool has_uv = !parsed_scene.tex_coord_data.empty();
-                if (has_uv)
-                {
-                  uvs[0] = create_vec2(parsed_scene.tex_coord_data[triangle_.v0_id]);
-                  uvs[1] = create_vec2(parsed_scene.tex_coord_data[triangle_.v1_id]);
-                  uvs[2] = create_vec2(parsed_scene.tex_coord_data[triangle_.v2_id]);
-                }
-
-                // 3. Tangent & Bitangent
-                Vec3 tangents[2];
-                if (has_uv) {
-                  Vec3 edge1 = vertices[1] - vertices[0];
-                  Vec3 edge2 = vertices[2] - vertices[0];
-                  auto a = uvs[1].x - uvs[0].x;
-                  auto b = uvs[1].y - uvs[0].y;
-                  auto c = uvs[2].x - uvs[0].x;
-                  auto d = uvs[2].y - uvs[0].y;
-                  float inv_det = 1.0f / (a * d - b * c);
-
-                  tangents[0] = inv_det * (d * edge1 - b * edge2);
-                  tangents[1] = inv_det * (-c * edge1 + a * edge2);
-                  tangents[0] = glm::normalize(tangents[0]);
-                  tangents[1] = glm::normalize(tangents[1]);
-                }
-                mesh_faces.push_back(Triangle(
-                    vertices, 
-                    nullptr, 
-                    has_uv ? uvs : nullptr, 
-                    has_uv ? tangents : nullptr,
-                    false
-                ));
+              cache_keys[i] = mesh_cache->data_key(data, scene.bvh_config_);
+              mesh_geos[i] = mesh_cache->load(cache_keys[i]);
+              if (mesh_geos[i])
+                continue;
+            }
+            mesh_geos[i] = std::make_shared<Mesh>(std::move(data),
+                                                  scene.bvh_config_);
+            if (mesh_cache)
+            {
+              mesh_cache->store(cache_keys[i], *mesh_geos[i]);
+              cache_keys[i] = 0;
             }
           }
 
-          auto mesh_geo = std::make_shared<Mesh>(mesh_faces);
+          if (mesh_cache)
+          {
+            // Keys of built meshes were cleared above, so the rest are hits.
+            int hits = static_cast<int>(std::count_if(
+                cache_keys.begin(), cache_keys.end(),
+                [](uint64_t key) { return key != 0; }));
+            LOG_INFO("Mesh cache: " << hits << " of " << num_meshes
+                     << " meshes loaded from " << options.mesh_cache_dir);
+          }
+        }
+
+        for (size_t i = 0; i < parsed_scene.meshes.size(); ++i)
+        {
+          const Parser::Mesh_ &mesh_ = parsed_scene.meshes[i];
+          const std::shared_ptr<Mesh> &mesh_geo = mesh_geos[i];
+          LOG_INFO("Mesh " << mesh_.id << ": " << mesh_geo->num_faces()
+                   << " triangles, BVH SAH cost " << mesh_geo->blas_.sah_cost());
+          if (options.stats)
+            LOG_INFO("Mesh " << mesh_.id << " BVH: " << mesh_geo->blas_.stats());
           auto inst = Instance(mesh_geo);
           glm::mat4 m_base = create_transformation_matrix(mesh_.transformations);
           inst.set_transform(m_base);
@@ -618,6 +830,7 @@ namespace hasmet
           inst.set_texture_ids(mesh_.texture_ids);
           inst.radiance_ = create_vec3(mesh_.radiance);
           object_registry[mesh_.id] = {mesh_geo, m_base};
+          object_indices.meshes[mesh_.id] = scene.objects_.size();
           scene.add_shape(std::move(inst));
         }
 
@@ -646,6 +859,9 @@ namespace hasmet
           mi_inst.set_texture_ids(mi_.texture_ids);
           mi_inst.radiance_ = create_vec3(mi_.radiance);
           object_registry[mi_.id] = {base_info.geometry, m_final};
+          object_indices.mesh_instances[mi_.id] = scene.objects_.size();
+          if (!mi_.reset_transform)
+            object_indices.instance_bases[mi_.id] = base_info.composite_transform;
           scene.objects_.push_back(std::move(mi_inst));
         }
 
@@ -673,7 +889,17 @@ namespace hasmet
           }
         }
         
-        scene.build_bvh();
+        {
+          SCOPED_TIMER("Scene BVH construction");
+          scene.build_bvh();
+        }
+        LOG_INFO("Scene BVH: " << scene.objects_.size()
+                 << " instances, SAH cost " << scene.bvh_.sah_cost());
+        if (options.stats)
+          LOG_INFO("Scene BVH: " << scene.bvh_.stats());
+
+        scene.animation_ = create_animation(parsed_scene, scene, object_indices,
+                                            mesh_geos);
         return scene;
       }
 
@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "camera/pinhole.h"
+#include "core/options.h"
 #include "parser/parser.h"
 #include "scene/scene.h"
 #include "core/types.h"
@@ -15,7 +16,9 @@ Color create_color(const Parser::Vec3f_ v_);
 PointLight create_point_light(const Parser::PointLight_ light_);
 Material create_material(const Parser::Material_& material_);
 PinholeCamera create_pinhole_camera(const Parser::Camera_& camera_);
-Scene read_scene(std::string filename);
+BvhBuildConfig create_bvh_config(const Parser::Scene_& scene_,
+                                 const Options& options);
+Scene read_scene(std::string filename, const Options& options = Options());
 Vec3 create_vec3(const Parser::Vec3f_& v_);
 
 }  // namespace ParserAdapter
@@ -0,0 +1,72 @@
+#include "animation.h"
+
+#include <algorithm>
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+
+#include "core/timer.h"
+#include "scene/scene.h"
+
+namespace hasmet {
+glm::mat4 interpolate_keyframes(const std::vector<TransformKeyframe>& keys,
+                                float frame) {
+  if (keys.empty()) return glm::mat4(1.0f);
+  if (frame <= keys.front().frame) return keys.front().transform;
+  if (frame >= keys.back().frame) return keys.back().transform;
+
+  auto next = std::upper_bound(
+      keys.begin(), keys.end(), frame,
+      [](float f, const TransformKeyframe& key) { return f < key.frame; });
+  const TransformKeyframe& b = *next;
+  const TransformKeyframe& a = *(next - 1);
+  if (frame == a.frame) return a.transform;
+  float t = (frame - a.frame) / static_cast<float>(b.frame - a.frame);
+
+  Vec3 scale[2], translation[2], skew;
+  glm::quat rotation[2];
+  glm::vec4 perspective;
+  if (!glm::decompose(a.transform, scale[0], rotation[0], translation[0],
+                      skew, perspective) ||
+      !glm::decompose(b.transform, scale[1], rotation[1], translation[1],
+                      skew, perspective)) {
+    return t < 0.5f ? a.transform : b.transform;
+  }
+  glm::mat4 m = glm::translate(glm::mat4(1.0f),
+                               glm::mix(translation[0], translation[1], t));
+  m *= glm::mat4_cast(glm::slerp(rotation[0], rotation[1], t));
+  return glm::scale(m, glm::mix(scale[0], scale[1], t));
+}
+
+void Animation::set_frame(Scene& scene, int frame) const {
+  for (const CameraTrack& track : camera_tracks) {
+    scene.cameras_[track.camera] =
+        track.create(interpolate_keyframes(track.keyframes, frame));
+  }
+
+  bool tlas_changed = false;
+  if (!mesh_sequences.empty()) {
+    SCOPED_TIMER("Mesh refit");
+    for (const MeshSequence& sequence : mesh_sequences) {
+      sequence.mesh->update(sequence.load(frame), scene.bvh_config_);
+      for (size_t object : sequence.instances) {
+        scene.objects_[object].refresh_bounds();
+      }
+      tlas_changed = true;
+    }
+  }
+
+  for (const InstanceTrack& track : instance_tracks) {
+    scene.objects_[track.object].set_transform(
+        interpolate_keyframes(track.keyframes, frame) * track.base);
+    tlas_changed = true;
+  }
+
+  if (tlas_changed) {
+    SCOPED_TIMER("Scene BVH update");
+    scene.update_bvh();
+  }
+}
+}  // namespace hasmet
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "camera/camera.h"
+#include "geometry/mesh.h"
+
+namespace hasmet {
+class Scene;
+
+struct TransformKeyframe {
+  int frame;
+  glm::mat4 transform;
+};
+
+// Transform at `frame` from keyframes sorted by frame. Keyframe frames
+// return their matrix exactly; in between, translation and scale are
+// interpolated linearly and rotation spherically. Holds the end values
+// outside the keyframe range.
+glm::mat4 interpolate_keyframes(const std::vector<TransformKeyframe>& keys,
+                                float frame);
+
+// Animates objects_[object]; its transform is the keyframed one times
+// `base` (the base mesh transform of a mesh instance, identity otherwise).
+struct InstanceTrack {
+  size_t object;
+  glm::mat4 base{1.0f};
+  std::vector<TransformKeyframe> keyframes;
+};
+
+// Replaces cameras_[camera] by create(transform) every frame.
+struct CameraTrack {
+  size_t camera;
+  std::vector<TransformKeyframe> keyframes;
+  std::function<std::unique_ptr<Camera>(const glm::mat4&)> create;
+};
+
+// Per-frame vertex data of a deforming mesh; `instances` index objects_.
+struct MeshSequence {
+  std::shared_ptr<Mesh> mesh;
+  std::vector<size_t> instances;
+  std::function<MeshData(int frame)> load;
+};
+
+// Frame range and everything that changes over it. Only what is animated
+// is touched per frame: deformed meshes refit their BLAS, moved instances
+// only update the TLAS, and all other BLASes are reused as they are.
+class Animation {
+ public:
+  bool empty() const { return last_frame < first_frame; }
+
+  // Poses the scene at `frame` and brings its TLAS up to date.
+  void set_frame(Scene& scene, int frame) const;
+
+  int first_frame = 0;
+  int last_frame = -1;
+  std::vector<InstanceTrack> instance_tracks;
+  std::vector<CameraTrack> camera_tracks;
+  std::vector<MeshSequence> mesh_sequences;
+};
+}  // namespace hasmet
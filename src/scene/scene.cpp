@@ -1,6 +1,7 @@
 #include "scene.h"
 
 #include "core/logging.h"
+#include <bit>
 #include <memory>
 namespace hasmet {
 Scene::Scene() {}
@@ -30,39 +31,100 @@ const Material* Scene::get_material(int id) const {
 }
 
 bool Scene::intersect(Ray& r, HitRecord& rec) const {
+  SceneQueryRecorder record(r.type, 1, plane_batch_.size());
   bool hit = false;
 
-  if (bvh_.intersect(r, rec)) {
+  // Planes go first so their hit bounds the TLAS traversal.
+  float plane_t;
+  int plane = plane_batch_.intersect(r, plane_t);
+  if (plane >= 0) {
     hit = true;
+    rec.t = plane_t;
+    rec.instance = &planes_[plane];
+    r.t_max = plane_t;
   }
 
-  for (const auto& plane : planes_) {
-    HitRecord temp_rec;
-    if (plane.intersect(r, temp_rec)) {
-      if (!hit || temp_rec.t < rec.t) {
-        hit = true;
-        rec = temp_rec;
-        r.t_max = rec.t;
-      }
-    }
-  }
+  if (bvh_.intersect(r, rec)) hit = true;
 
+  if (hit) {
+    record.add_hits(1);
+    rec.instance->finalize_hit(r, rec);
+  }
   return hit;
 }
 
 bool Scene::is_occluded(const Ray& r) const {
-  if (bvh_.is_occluded(r)) return true;
+  SceneQueryRecorder record(RayType::Shadow, 1, plane_batch_.size());
+  bool occluded = plane_batch_.occluded(r) || bvh_.is_occluded(r);
+  if (occluded) record.add_hits(1);
+  return occluded;
+}
 
-  HitRecord temp_rec;
-  Ray shadow_ray = r;
-  for (const auto& plane : planes_) {
-    if (plane.intersect(shadow_ray, temp_rec)) return true;
-  }
+uint32_t Scene::intersect(RayPacket& packet, uint32_t mask,
+                          HitRecord* recs) const {
+  if (mask == 0) return 0;
+  int num_rays = std::popcount(mask);
+  SceneQueryRecorder record(packet.first(mask).type,
+                            num_rays, plane_batch_.size() * num_rays);
+
+  uint32_t hit = 0;
+  for_each_ray(mask, [&](int i) {
+    float plane_t;
+    int plane = plane_batch_.intersect(packet.rays[i], plane_t);
+    if (plane < 0) return;
+    hit |= 1u << i;
+    recs[i].t = plane_t;
+    recs[i].instance = &planes_[plane];
+    packet.rays[i].t_max = plane_t;
+  });
+
+  hit |= bvh_.intersect_packet(packet, mask, recs);
+
+  record.add_hits(std::popcount(hit));
+  for_each_ray(hit, [&](int i) {
+    recs[i].instance->finalize_hit(packet.rays[i], recs[i]);
+  });
+  return hit;
+}
+
+uint32_t Scene::is_occluded(const RayPacket& packet, uint32_t mask) const {
+  if (mask == 0) return 0;
+  int num_rays = std::popcount(mask);
+  SceneQueryRecorder record(RayType::Shadow, num_rays,
+                            plane_batch_.size() * num_rays);
+
+  uint32_t occluded = 0;
+  for_each_ray(mask, [&](int i) {
+    if (plane_batch_.occluded(packet.rays[i])) occluded |= 1u << i;
+  });
+  occluded |= bvh_.is_occluded_packet(packet, mask & ~occluded);
+  record.add_hits(std::popcount(occluded));
+  return occluded;
+}
 
-  return false;
+// The TLAS indexes objects_ directly, so shapes must not be added after this.
+void Scene::build_bvh() {
+  bvh_.build_indexed(objects_, bvh_config_);
+  tlas_build_cost_ = bvh_.sah_cost();
+
+  plane_batch_.clear();
+  for (const Instance& inst : planes_) {
+    // planes_ only ever holds Plane instances.
+    const Plane& plane = static_cast<const Plane&>(inst.object());
+    plane_batch_.add(inst.transform().apply_point(plane.center()),
+                     inst.normal_matrix() * plane.normal());
+  }
 }
 
-void Scene::build_bvh() { bvh_.build(objects_); }
+void Scene::update_bvh() {
+  bvh_.refit();
+  if (bvh_.sah_cost() > kTlasRebuildRatio * tlas_build_cost_) {
+    LOG_INFO("TLAS SAH cost grew from " << tlas_build_cost_ << " to "
+             << bvh_.sah_cost() << ", rebuilding");
+    bvh_.build_indexed(objects_, bvh_config_);
+    tlas_build_cost_ = bvh_.sah_cost();
+  }
+}
 
 int Scene::get_total_light_count() const {
   return static_cast<int>(point_lights_.size() + area_lights_.size() +
@@ -13,9 +13,11 @@
 #include "accelerator/bvh.h"
 #include "camera/pinhole.h"
 #include "geometry/plane.h"
+#include "geometry/plane_batch.h"
 #include "camera/thinlens.h"
 #include "core/types.h"
 #include "accelerator/instance.h"
+#include "scene/animation.h"
 
 namespace hasmet {
 struct RenderContext{
@@ -26,13 +28,23 @@ struct RenderContext{
   int num_samples;
 };
 
+constexpr float kTlasRebuildRatio = 1.5f;
+
 class Scene {
  public:
   Scene();
 
   bool intersect(Ray& r, HitRecord& rec) const;
   bool is_occluded(const Ray& r) const;
+  // Packet versions for the rays in `mask`; they return the rays that hit
+  // or are occluded. Hits are finalized like those of intersect.
+  uint32_t intersect(RayPacket& packet, uint32_t mask, HitRecord* recs) const;
+  uint32_t is_occluded(const RayPacket& packet, uint32_t mask) const;
   void build_bvh();
+  // Brings the TLAS up to date after instances moved or their objects
+  // changed: refits it, or rebuilds it once the refit tree's SAH cost has
+  // grown past kTlasRebuildRatio times the cost at the last build.
+  void update_bvh();
 
   void add_shape(Instance shape);
   void add_point_light(std::unique_ptr<PointLight> light);
@@ -47,6 +59,8 @@ class Scene {
   std::vector<Instance> objects_;
   std::vector<int> light_indices_;
   std::vector<Instance> planes_;
+  // World-space copy of planes_ for the batched test; built by build_bvh.
+  PlaneBatch plane_batch_;
   std::vector<std::unique_ptr<PointLight>> point_lights_;
   std::vector<std::unique_ptr<AreaLight>> area_lights_;
   std::vector<std::unique_ptr<SpotLight>> spot_lights_;
@@ -55,7 +69,12 @@ class Scene {
   std::vector<std::unique_ptr<Camera>> cameras_;
   std::unique_ptr<AmbientLight> ambient_light_;
   RenderContext render_context_;
+  BvhBuildConfig bvh_config_;
+  Animation animation_;
   std::vector<std::unique_ptr<Material>> materials_;
+
+ private:
+  float tlas_build_cost_ = 0.0f;
 };
 
 } // namespace hasmet
\ No newline at end of file